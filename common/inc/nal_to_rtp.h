@@ -1,6 +1,8 @@
 #if !defined(__H264_TO_RTP__)
 #define __H264_TO_RTP__
 
+#include "sx_seg.h"
+
 #if defined(cplusplus)
 extern "C"
 {
@@ -15,8 +17,7 @@ typedef struct
     unsigned char   m_pt; 
     unsigned short  sequence_number; 
     unsigned int    timestamp; 
-    unsigned short  ssrc; 
-    unsigned short  csrc; 
+    unsigned int    ssrc;               ///< Per session, no CSRC list. 
 
 } sRTP_HEADER; 
 
@@ -48,6 +49,39 @@ typedef struct sRTP_PKT_NODE
 } sRTP_PKT_NODE;
 
 
+// Payload pieces of a described packet at most. Chained segments are
+// 64 KB, a fragment spans three only behind a short head segment.
+#define RTP_DESC_SEGS_MAX   3
+
+// Iovecs of a described packet behind a session header, at most.
+#define RTP_DESC_IOV_MAX    (2 + RTP_DESC_SEGS_MAX)
+
+
+// RTP packet described in place: its header and FU-A bytes here, the
+// payload left in the NAL unit's segments, which must outlive it.
+typedef struct sRTP_PKT_DESC
+{
+    struct sRTP_PKT_DESC   *next;           ///< Next packet.
+    sRTP_HEADER             header;         ///< Session independent header fields.
+    unsigned char           fu[2];          ///< FU indicator and header.
+    unsigned char           fu_len;         ///< 2 for a fragment, 0 for a whole NAL unit.
+    unsigned char           seg_count;      ///< Payload pieces.
+    struct iovec            segs[RTP_DESC_SEGS_MAX];    ///< Payload, in the NAL unit.
+    unsigned int            rtp_pkt_len;    ///< Packet length.
+
+} sRTP_PKT_DESC;
+
+
+// RTP timestamp to wallclock mapping, as carried in an RTCP sender report.
+typedef struct
+{
+    unsigned int    ntp_sec;        ///< NTP seconds since 1900.
+    unsigned int    ntp_frac;       ///< NTP fraction of a second.
+    unsigned int    rtp_timestamp;  ///< RTP timestamp of the same instant.
+
+} sRTP_CLOCK_MAP;
+
+
 extern void * sx_nal_to_rtp_util_create(
     void
     );
@@ -59,15 +93,75 @@ extern void sx_nal_to_rtp_util_destroy(
 
 
 extern sRTP_PKT_NODE * sx_nal_to_rtp_util_get(
-    void           *arg,
-    unsigned char  *h264_frame, 
-    unsigned int    h264_frame_len
+    void               *arg,
+    const sSX_SEG      *h264_frame, 
+    unsigned int        h264_frame_len,
+    unsigned long long  pts,
+    unsigned char       au_end
+    ); 
+
+
+extern sRTP_PKT_NODE * sx_nal_to_rtp_util_packetize(
+    const sSX_SEG      *h264_frame, 
+    unsigned int        h264_frame_len,
+    unsigned char       au_end
     ); 
 
 
+extern sRTP_PKT_DESC * sx_nal_to_rtp_util_describe(
+    const sSX_SEG      *h264_frame, 
+    unsigned int        h264_frame_len,
+    unsigned char       au_end
+    ); 
+
+
+extern unsigned int sx_nal_to_rtp_util_desc_iov(
+    const sRTP_PKT_DESC    *desc,
+    const sRTP_HEADER      *hdr,
+    struct iovec           *iov
+    );
+
+
+extern void sx_nal_to_rtp_util_desc_free(
+    sRTP_PKT_DESC      *head
+    );
+
+
+extern unsigned int sx_nal_to_rtp_util_timestamp_get(
+    void               *arg,
+    unsigned long long  pts
+    );
+
+
+extern void sx_nal_to_rtp_util_header_stamp(
+    void               *arg,
+    const sRTP_HEADER  *shared,
+    unsigned int        timestamp,
+    sRTP_HEADER        *hdr
+    );
+
+
+extern void sx_nal_to_rtp_util_sequence_rewind(
+    void               *arg,
+    unsigned int        count
+    );
+
+
+extern void sx_nal_to_rtp_util_clock_map_get(
+    void               *arg,
+    sRTP_CLOCK_MAP     *map
+    );
+
+
 extern void sx_nal_to_rtp_util_free(
      sRTP_PKT_NODE * head
     );
+
+
+extern void sx_nal_to_rtp_benchmark(
+    unsigned int        sessions,
+    unsigned int        iterations
+    );
  
 #if defined(cplusplus)
 }
@@ -0,0 +1,20 @@
+
+#if !defined(_SX_CLOCK_H_)
+#define _SX_CLOCK_H_
+
+#define SX_CLOCK_US_PER_SEC     1000000ULL
+
+// Seconds between the NTP (1900) and Unix (1970) epochs.
+#define SX_CLOCK_NTP_UNIX_OFFSET    2208988800U
+
+extern unsigned long long sx_clock_mono_us(
+    void
+    );
+
+extern void sx_clock_ntp_get(
+    unsigned long long  mono_us,
+    unsigned int       *ntp_sec,
+    unsigned int       *ntp_frac
+    );
+
+#endif // #if !defined(_SX_CLOCK_H_)
@@ -0,0 +1,77 @@
+#if !defined(_SX_MAILBOX_H_)
+#define _SX_MAILBOX_H_
+
+// In-process mailbox: any number of threads send fixed size messages, one
+// thread receives them. Each priority lane is a lock-free ring; receive
+// always empties the control lane before it takes from the data lane.
+
+#define SX_MAILBOX  void *
+
+// sx_mailbox_recv_wait() timeout that never expires.
+#define SX_MAILBOX_WAIT_FOREVER     0xFFFFFFFF
+
+typedef enum
+{
+    SX_MAILBOX_LANE_CONTROL,        ///< State changes (activate, reset, ...).
+    SX_MAILBOX_LANE_DATA,           ///< Work notifications (service, ...).
+    SX_MAILBOX_LANE_NUM,
+
+} eSX_MAILBOX_LANE;
+
+
+typedef struct
+{
+    unsigned int    send_count[SX_MAILBOX_LANE_NUM];    ///< Messages sent per lane.
+    unsigned int    wakeup_count;   ///< Sends that had to wake the receiver.
+    unsigned int    full_count;     ///< Sends that found their lane full and waited.
+
+} sSX_MAILBOX_STATS;
+
+
+extern SX_MAILBOX sx_mailbox_create(
+    unsigned int        msg_size,
+    unsigned int        lane_size
+    );
+
+extern void sx_mailbox_send(
+    SX_MAILBOX          mailbox,
+    eSX_MAILBOX_LANE    lane,
+    const void         *msg
+    );
+
+extern void sx_mailbox_recv(
+    SX_MAILBOX          mailbox,
+    void               *msg
+    );
+
+extern unsigned char sx_mailbox_recv_wait(
+    SX_MAILBOX          mailbox,
+    void               *msg,
+    unsigned int        timeout_us
+    );
+
+extern unsigned char sx_mailbox_try_recv(
+    SX_MAILBOX          mailbox,
+    void               *msg
+    );
+
+extern unsigned char sx_mailbox_poll(
+    SX_MAILBOX          mailbox,
+    void               *msg
+    );
+
+extern int sx_mailbox_fd_get(
+    SX_MAILBOX          mailbox
+    );
+
+extern void sx_mailbox_stats_get(
+    SX_MAILBOX          mailbox,
+    sSX_MAILBOX_STATS  *stats
+    );
+
+extern void sx_mailbox_stats_log(
+    SX_MAILBOX          mailbox,
+    const char         *name
+    );
+
+#endif // _SX_MAILBOX_H_
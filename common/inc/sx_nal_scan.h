@@ -0,0 +1,56 @@
+
+#if !defined(_SX_NAL_SCAN_H_)
+#define _SX_NAL_SCAN_H_
+
+// NAL unit flags.
+#define SX_NAL_FLAG_AU_START        0x01    ///< First NAL unit of an access unit.
+#define SX_NAL_FLAG_AU_END          0x02    ///< Last NAL unit of an access unit.
+#define SX_NAL_FLAG_CONTINUATION    0x04    ///< Bytes before the first start code.
+
+typedef struct
+{
+    unsigned char  *nal;            ///< NAL unit (no start code).
+    unsigned int    nal_len;        ///< NAL unit length, trailing zeros dropped.
+    unsigned char   flags;          ///< SX_NAL_FLAG_xxx.
+
+} sSX_NAL;
+
+// Access unit tracker, carried across buffers of one stream.
+typedef struct
+{
+    unsigned char   vcl_seen;       ///< Current access unit has a slice.
+    unsigned char   started;        ///< First NAL unit of the stream seen.
+
+} sSX_NAL_AU;
+
+extern const unsigned char * sx_nal_scan(
+    const unsigned char    *data,
+    const unsigned char    *end
+    );
+
+extern const unsigned char * sx_nal_scan_bytewise(
+    const unsigned char    *data,
+    const unsigned char    *end
+    );
+
+extern unsigned char sx_nal_au_start(
+    sSX_NAL_AU             *au,
+    const unsigned char    *nal,
+    unsigned int            nal_len
+    );
+
+extern unsigned int sx_nal_split(
+    sSX_NAL_AU             *au,
+    unsigned char          *data,
+    unsigned int            len,
+    sSX_NAL                *nals,
+    unsigned int            nals_max,
+    unsigned int           *used
+    );
+
+extern void sx_nal_scan_benchmark(
+    unsigned int            size,
+    unsigned int            iterations
+    );
+
+#endif // #if !defined(_SX_NAL_SCAN_H_)
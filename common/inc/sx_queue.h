@@ -3,10 +3,72 @@
 
 #define SX_QUEUE    void *
 
+// sx_queue_pull_wait() timeout that never expires.
+#define SX_QUEUE_WAIT_FOREVER   0xFFFFFFFF
+
+// What a bounded queue does with a push when it is full.
+typedef enum
+{
+    SX_QUEUE_POLICY_BLOCK,          ///< Producer waits for room.
+    SX_QUEUE_POLICY_DROP_NEWEST,    ///< Pushed entry is dropped.
+    SX_QUEUE_POLICY_DROP_OLDEST,    ///< Oldest entry is dropped to make room.
+    SX_QUEUE_POLICY_DROP_TO_KEY,    ///< Drop up to the last queued key entry. If that is the head,
+                                    ///< drop pushes until the next key entry, with none queued
+                                    ///< everything too.
+
+} eSX_QUEUE_POLICY;
+
+
+// Disposes of an entry the queue dropped. Called without the queue lock.
+typedef void (*fSX_QUEUE_DROP) (
+    void   *user_arg,
+    void   *data
+);
+
+// The queue drops pushes until a key entry. Called without the queue
+// lock, e.g. to have the producer make one.
+typedef void (*fSX_QUEUE_FLUSH) (
+    void   *user_arg
+);
+
+// Can a consumer resume from this entry (SX_QUEUE_POLICY_DROP_TO_KEY)?
+typedef unsigned char (*fSX_QUEUE_IS_KEY) (
+    void   *user_arg,
+    void   *data
+);
+
+
+typedef struct
+{
+    unsigned int        capacity;   ///< Entries queued at most, 0 = unbounded.
+    eSX_QUEUE_POLICY    policy;     ///< Overflow policy.
+    fSX_QUEUE_DROP      drop;       ///< Dropped entry disposal, drop policies only.
+    fSX_QUEUE_IS_KEY    is_key;     ///< Key entry test, SX_QUEUE_POLICY_DROP_TO_KEY only.
+    fSX_QUEUE_FLUSH     flush;      ///< Optional, SX_QUEUE_POLICY_DROP_TO_KEY only.
+    void               *user_arg;   ///< Callback argument.
+
+} sSX_QUEUE_CONFIG;
+
+
+typedef struct
+{
+    unsigned int    len;            ///< Entries queued.
+    unsigned int    len_peak;       ///< High water mark of len.
+    unsigned int    block_count;    ///< Pushes that waited for room.
+    unsigned int    drop_newest;    ///< Pushed entries dropped.
+    unsigned int    drop_oldest;    ///< Queued entries dropped.
+    unsigned int    flush_count;    ///< Overflows that emptied the queue to wait for a key entry.
+
+} sSX_QUEUE_STATS;
+
 extern SX_QUEUE sx_queue_create(
     void
     );
 
+extern SX_QUEUE sx_queue_create_bounded(
+    const sSX_QUEUE_CONFIG *config
+    );
+
 extern void sx_queue_destroy(
     SX_QUEUE    queue
     );
@@ -20,8 +82,33 @@ extern void * sx_queue_pull(
     SX_QUEUE    queue
     );
 
+extern void * sx_queue_pull_wait(
+    SX_QUEUE        queue_id,
+    unsigned int    timeout_us
+    );
+
+extern unsigned int sx_queue_pull_many(
+    SX_QUEUE        queue_id,
+    void          **data,
+    unsigned int    count_max
+    );
+
 extern unsigned int sx_queue_len_get(
     SX_QUEUE    queue_id
     );
 
+extern void sx_queue_stats_get(
+    SX_QUEUE            queue_id,
+    sSX_QUEUE_STATS    *stats
+    );
+
+extern void sx_queue_stats_log(
+    SX_QUEUE            queue_id,
+    const char         *name
+    );
+
+extern const char * sx_queue_policy_name_get(
+    eSX_QUEUE_POLICY    policy
+    );
+
 #endif // _SX_QUEUE_H_
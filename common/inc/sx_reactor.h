@@ -0,0 +1,68 @@
+#if !defined(_SX_REACTOR_H_)
+#define _SX_REACTOR_H_
+
+#include "sx_mailbox.h"
+#include "sx_timer.h"
+
+// Single-threaded run-to-completion event loop. Managers register their
+// sockets and mailboxes instead of starting threads; sx_reactor_run()
+// waits on all of them with one epoll and runs every handler to
+// completion on the calling thread. Timers go on the reactor's wheel.
+
+// File descriptors and mailboxes registered at once, at most.
+#define SX_REACTOR_FDS_MAX      64
+
+// Flush callbacks registered at once, at most.
+#define SX_REACTOR_FLUSHES_MAX  8
+
+
+// Invoked on the reactor thread when a registered fd is readable, or a
+// registered mailbox may hold messages, or at the end of every round of
+// events for a flush callback.
+typedef void (*fSX_REACTOR_CBACK) (
+    void   *arg
+);
+
+
+extern void sx_reactor_init(
+    void
+    );
+
+extern unsigned char sx_reactor_enabled(
+    void
+    );
+
+extern void sx_reactor_fd_add(
+    int                 fd,
+    fSX_REACTOR_CBACK   cback,
+    void               *arg
+    );
+
+extern void sx_reactor_fd_remove(
+    int                 fd
+    );
+
+extern void sx_reactor_mailbox_add(
+    SX_MAILBOX          mailbox,
+    fSX_REACTOR_CBACK   cback,
+    void               *arg
+    );
+
+extern void sx_reactor_flush_add(
+    fSX_REACTOR_CBACK   cback,
+    void               *arg
+    );
+
+extern SX_TIMER_WHEEL sx_reactor_wheel_get(
+    void
+    );
+
+extern void sx_reactor_run(
+    void
+    );
+
+extern void sx_reactor_stats_log(
+    void
+    );
+
+#endif // _SX_REACTOR_H_
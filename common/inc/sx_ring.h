@@ -0,0 +1,54 @@
+#if !defined(_SX_RING_H_)
+#define _SX_RING_H_
+
+// Lock-free single producer, single consumer ring of pointers. Exactly one
+// thread may push and one thread may pull. Unlike sx_queue it is bounded
+// and never allocates once created.
+
+#define SX_RING     void *
+
+// Producer and consumer indices live on separate lines of this size.
+#define SX_RING_CACHE_LINE  64
+
+extern SX_RING sx_ring_create(
+    unsigned int    size
+    );
+
+extern void sx_ring_destroy(
+    SX_RING         ring
+    );
+
+extern unsigned char sx_ring_push(
+    SX_RING         ring,
+    void           *data
+    );
+
+extern void * sx_ring_pull(
+    SX_RING         ring
+    );
+
+extern unsigned int sx_ring_push_many(
+    SX_RING         ring,
+    void          **data,
+    unsigned int    count
+    );
+
+extern unsigned int sx_ring_pull_many(
+    SX_RING         ring,
+    void          **data,
+    unsigned int    count_max
+    );
+
+extern unsigned int sx_ring_len_get(
+    SX_RING         ring
+    );
+
+extern unsigned int sx_ring_size_get(
+    SX_RING         ring
+    );
+
+extern void sx_ring_benchmark(
+    unsigned int    items
+    );
+
+#endif // _SX_RING_H_
@@ -0,0 +1,69 @@
+
+#if !defined(_SX_SEG_H_)
+#define _SX_SEG_H_
+
+#include <sys/uio.h>
+
+// Payload of a chained segment. With its header it fits the 64 KB slab
+// class.
+#define SX_SEG_SIZE     (65536 - 64)
+
+// One segment of a payload chain. The head usually lives inside the
+// owning buffer, segments chained on by sx_seg_append() come from the
+// slab and are freed with sx_seg_chain_free().
+typedef struct sSX_SEG
+{
+    struct sSX_SEG *next;           ///< Next segment, NULL on the last one.
+    unsigned char  *data;           ///< Payload.
+    unsigned int    len;            ///< Payload bytes in use.
+    unsigned int    size;           ///< Payload capacity.
+
+} sSX_SEG;
+
+// Read position in a chain.
+typedef struct
+{
+    const sSX_SEG  *seg;            ///< Current segment.
+    unsigned int    offset;         ///< Offset in the current segment.
+
+} sSX_SEG_CURSOR;
+
+extern void sx_seg_init(
+    sSX_SEG                *seg,
+    unsigned char          *data,
+    unsigned int            size
+    );
+
+extern void sx_seg_append(
+    sSX_SEG                *head,
+    const unsigned char    *data,
+    unsigned int            len
+    );
+
+extern unsigned int sx_seg_trim_zeros(
+    sSX_SEG                *head
+    );
+
+extern void sx_seg_chain_free(
+    sSX_SEG                *seg
+    );
+
+extern void sx_seg_cursor_init(
+    sSX_SEG_CURSOR         *cursor,
+    const sSX_SEG          *head
+    );
+
+extern unsigned int sx_seg_read(
+    sSX_SEG_CURSOR         *cursor,
+    unsigned char          *dst,
+    unsigned int            len
+    );
+
+extern unsigned int sx_seg_map(
+    sSX_SEG_CURSOR         *cursor,
+    struct iovec           *iov,
+    unsigned int            iov_max,
+    unsigned int            len
+    );
+
+#endif // #if !defined(_SX_SEG_H_)
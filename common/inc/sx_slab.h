@@ -0,0 +1,50 @@
+
+#if !defined(_SX_SLAB_H_)
+#define _SX_SLAB_H_
+
+// Size classes are powers of two from 64 bytes to 256 KB (header included).
+// Larger requests fall through to malloc().
+#define SX_SLAB_CLASS_MIN_SHIFT     6
+#define SX_SLAB_CLASS_MAX_SHIFT     18
+#define SX_SLAB_CLASS_NUM           (SX_SLAB_CLASS_MAX_SHIFT - SX_SLAB_CLASS_MIN_SHIFT + 1)
+
+// Freed blocks cached per class before they go back to the heap.
+#define SX_SLAB_FREELIST_MAX        32
+
+typedef struct
+{
+    unsigned int    block_size;     ///< Class block size (header included).
+    unsigned int    alloc_count;    ///< Allocations served.
+    unsigned int    miss_count;     ///< Allocations that went to malloc().
+    unsigned int    in_use;         ///< Blocks currently handed out.
+    unsigned int    in_use_peak;    ///< High water mark of in_use.
+    unsigned int    cached;         ///< Blocks on the freelist.
+
+} sSX_SLAB_CLASS_STATS;
+
+extern void * sx_slab_alloc(
+    unsigned int    size
+    );
+
+extern void * sx_slab_realloc(
+    void           *ptr,
+    unsigned int    size
+    );
+
+extern void sx_slab_free(
+    void           *ptr
+    );
+
+extern unsigned int sx_slab_size_get(
+    void           *ptr
+    );
+
+extern void sx_slab_stats_get(
+    sSX_SLAB_CLASS_STATS    stats[SX_SLAB_CLASS_NUM]
+    );
+
+extern void sx_slab_stats_log(
+    void
+    );
+
+#endif // #if !defined(_SX_SLAB_H_)
@@ -0,0 +1,102 @@
+#if !defined(_SX_TIMER_H_)
+#define _SX_TIMER_H_
+
+// Hierarchical timer wheel. Timers are embedded in their owner's data and
+// armed or cancelled in O(1); one timerfd per wheel fires at the earliest
+// expiry only, so idle timers cost no wakeups. A wheel belongs to the
+// thread (or event loop) that runs it, arm and cancel its timers from
+// that thread only.
+
+#define SX_TIMER_WHEEL  void *
+
+// Wheel resolution (us). Timers never fire early, at most this late.
+#define SX_TIMER_TICK_US        250
+
+// Levels of 64 slots, each 64 times coarser than the one below. Four
+// cover about 70 minutes, later expiries are parked in the last level.
+#define SX_TIMER_LEVEL_BITS     6
+#define SX_TIMER_LEVELS         4
+
+
+typedef void (*fSX_TIMER_CBACK) (
+    void   *arg
+);
+
+
+typedef struct sSX_TIMER
+{
+    struct sSX_TIMER   *next;       ///< Slot list link, NULL when not armed.
+    struct sSX_TIMER   *prev;       ///< Slot list link.
+    void               *wheel;      ///< Wheel it runs on.
+    unsigned int        slot;       ///< Level and slot it is linked in.
+    unsigned long long  expires;    ///< Expiry (ticks).
+    fSX_TIMER_CBACK     cback;      ///< Expiry callback, on the wheel's thread.
+    void               *arg;        ///< Callback argument.
+
+} sSX_TIMER;
+
+
+typedef struct
+{
+    unsigned int    arm_count;      ///< Timers armed.
+    unsigned int    cancel_count;   ///< Armed timers cancelled.
+    unsigned int    expire_count;   ///< Callbacks run.
+    unsigned int    cascade_count;  ///< Timers moved down a level.
+    unsigned int    run_count;      ///< sx_timer_wheel_run() calls.
+    unsigned int    rearm_count;    ///< timerfd updates.
+
+} sSX_TIMER_STATS;
+
+
+extern SX_TIMER_WHEEL sx_timer_wheel_create(
+    void
+    );
+
+extern int sx_timer_wheel_fd_get(
+    SX_TIMER_WHEEL      wheel
+    );
+
+extern unsigned long long sx_timer_wheel_next_get(
+    SX_TIMER_WHEEL      wheel
+    );
+
+extern void sx_timer_wheel_run(
+    SX_TIMER_WHEEL      wheel
+    );
+
+extern void sx_timer_wheel_stats_get(
+    SX_TIMER_WHEEL      wheel,
+    sSX_TIMER_STATS    *stats
+    );
+
+extern void sx_timer_wheel_stats_log(
+    SX_TIMER_WHEEL      wheel,
+    const char         *name
+    );
+
+extern void sx_timer_init(
+    sSX_TIMER          *timer,
+    SX_TIMER_WHEEL      wheel,
+    fSX_TIMER_CBACK     cback,
+    void               *arg
+    );
+
+extern void sx_timer_arm(
+    sSX_TIMER          *timer,
+    unsigned long long  expires_us
+    );
+
+extern void sx_timer_cancel(
+    sSX_TIMER          *timer
+    );
+
+extern unsigned char sx_timer_pending(
+    const sSX_TIMER    *timer
+    );
+
+extern void sx_timer_benchmark(
+    unsigned int        timers,
+    unsigned int        rounds
+    );
+
+#endif // _SX_TIMER_H_
@@ -0,0 +1,108 @@
+#if !defined(_SX_URING_H_)
+#define _SX_URING_H_
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// io_uring send backend. Sends are queued as SQEs on fixed files (and
+// registered buffers where the data can be copied in) and go to the
+// kernel with one io_uring_enter(), which also waits for their
+// completions; those are then taken in a batch. A ring belongs to one
+// thread at a time. Callers keep their plain syscall path for when
+// sx_uring_create() returns NULL: not selected, built with
+// SX_IO_URING=0, or refused by the kernel.
+
+#define SX_URING    void *
+
+
+typedef struct
+{
+    unsigned long long  user_data;  ///< As queued.
+    int                 res;        ///< Bytes sent, or -errno.
+
+} sSX_URING_CQE;
+
+
+typedef struct
+{
+    unsigned int    sqe_count;      ///< Operations queued.
+    unsigned int    enter_count;    ///< io_uring_enter() calls.
+    unsigned int    cqe_count;      ///< Completions taken.
+    unsigned int    error_count;    ///< Completions with an error.
+
+} sSX_URING_STATS;
+
+
+extern void sx_uring_init(
+    void
+    );
+
+extern unsigned char sx_uring_enabled(
+    void
+    );
+
+extern SX_URING sx_uring_create(
+    unsigned int        entries
+    );
+
+extern void sx_uring_destroy(
+    SX_URING            ring
+    );
+
+extern int sx_uring_files_register(
+    SX_URING            ring,
+    const int          *fds,
+    unsigned int        count
+    );
+
+extern int sx_uring_file_update(
+    SX_URING            ring,
+    unsigned int        index,
+    int                 fd
+    );
+
+extern int sx_uring_buffers_register(
+    SX_URING            ring,
+    const struct iovec *iov,
+    unsigned int        count
+    );
+
+extern unsigned char sx_uring_sendmsg_queue(
+    SX_URING            ring,
+    unsigned int        file,
+    const struct msghdr*msg,
+    unsigned char       link,
+    unsigned long long  user_data
+    );
+
+extern unsigned char sx_uring_write_fixed_queue(
+    SX_URING            ring,
+    unsigned int        file,
+    unsigned int        buf,
+    const void         *data,
+    unsigned int        len,
+    unsigned long long  user_data
+    );
+
+extern int sx_uring_submit(
+    SX_URING            ring,
+    unsigned int        wait
+    );
+
+extern unsigned int sx_uring_reap(
+    SX_URING            ring,
+    sSX_URING_CQE      *cqes,
+    unsigned int        max
+    );
+
+extern void sx_uring_stats_get(
+    SX_URING            ring,
+    sSX_URING_STATS    *stats
+    );
+
+extern void sx_uring_stats_log(
+    SX_URING            ring,
+    const char         *name
+    );
+
+#endif // _SX_URING_H_
@@ -1,22 +1,47 @@
 #include "stdio.h" 
 #include "stdlib.h" 
 #include "string.h" 
+#include "time.h" 
+#include "assert.h" 
+#include <arpa/inet.h>
+#include "logger.h"
+#include "sx_clock.h"
+#include "sx_seg.h"
 #include "nal_to_rtp.h"
 
 #define FUA_FRAGMENT_START  0x80
 #define FUA_FRAGMENT_MIDDLE 0x00
 #define FUA_FRAGMENT_END    0x40
 
+// H.264 RTP clock rate (RFC 6184).
+#define RTP_CLOCK_RATE      90000ULL
+
+// Benchmark NAL unit, a large slice spanning two segments.
+#define RTP_BENCH_NAL_LEN   (96 * 1024)
+
 
 // Module control block. 
 typedef struct
 {
     unsigned int    timestamp; 
+    unsigned int    timestamp_offset;   ///< Random RTP timestamp origin. 
     unsigned int    sequence_number; 
+    unsigned int    ssrc;               ///< Random synchronization source. 
 
 } sH264_TO_RTP_CBLK; 
 
 
+// RTP timestamp of a capture time, 90 kHz from the pts, rounded so us
+// truncation in the pts does not show up as one tick of jitter.
+static unsigned int rtp_timestamp_get(
+    sH264_TO_RTP_CBLK  *cblk,
+    unsigned long long  pts
+    )
+{
+    return (unsigned int) ((pts * RTP_CLOCK_RATE + SX_CLOCK_US_PER_SEC / 2) / SX_CLOCK_US_PER_SEC) + cblk->timestamp_offset; 
+}
+
+
 // Function definition to allocate a node. 
 static sRTP_PKT_NODE  *node_malloc(
     void
@@ -34,24 +59,30 @@ static sRTP_PKT_NODE  *node_malloc(
 }
 
 
-// Set RTP header. 
+// Set the session independent RTP header fields. 
 static void rtp_header_set(
-    sH264_TO_RTP_CBLK  *cblk,
     sRTP_HEADER        *hdr,
     unsigned char       m_bit_set
     )
 {
     hdr->version_p_x_cc     = 0x80; 
     hdr->m_pt               = m_bit_set << 7 | 0x60; 
-    hdr->sequence_number    = ntohs(cblk->sequence_number++);
-    hdr->timestamp          = ntohl(cblk->timestamp);
-    hdr->ssrc               = 0x1; 
-    hdr->csrc               = 0x2; 
+    hdr->sequence_number    = 0;
+    hdr->timestamp          = 0;
+    hdr->ssrc               = 0; 
+}
 
-    if(m_bit_set)
-    {
-        cblk->timestamp += 3600;
-    }
+
+// Set the session's sequence number, timestamp and SSRC. 
+static void rtp_header_stamp(
+    sH264_TO_RTP_CBLK  *cblk,
+    sRTP_HEADER        *hdr,
+    unsigned int        timestamp
+    )
+{
+    hdr->sequence_number    = ntohs(cblk->sequence_number++);
+    hdr->timestamp          = ntohl(timestamp);
+    hdr->ssrc               = htonl(cblk->ssrc);
 }
 
 
@@ -80,22 +111,24 @@ static void h264_fua_header_set(
 
 // Get single packet slice. 
 static sRTP_PKT_NODE * get_single_pkt_chain(
-    sH264_TO_RTP_CBLK  *cblk,
-    unsigned char      *h264_frame,
-    unsigned int        h264_frame_len
+    const sSX_SEG      *h264_frame,
+    unsigned int        h264_frame_len,
+    unsigned char       au_end
     )
 {
     sRTP_PKT_NODE   *node; 
+    sSX_SEG_CURSOR   cursor; 
 
 
     // Get node. 
     node = node_malloc(); 
 
-    // Set header.
-    rtp_header_set(cblk, &node->rtp_pkt.header, 1);
+    // Set header, marker on the last NAL unit of the access unit only.
+    rtp_header_set(&node->rtp_pkt.header, au_end);
 
     // Set payload. 
-    memcpy(&node->rtp_pkt.payload.bytes[0], h264_frame, h264_frame_len); 
+    sx_seg_cursor_init(&cursor, h264_frame); 
+    sx_seg_read(&cursor, &node->rtp_pkt.payload.bytes[0], h264_frame_len); 
 
     // Set pkt length. 
     node->rtp_pkt_len = sizeof(sRTP_HEADER) + h264_frame_len; 
@@ -104,18 +137,20 @@ static sRTP_PKT_NODE * get_single_pkt_chain(
 }
 
 
-// Get multi packet slice. 
+// Get multi packet slice. Fragments are read straight out of the
+// segment chain, across segment boundaries. 
 static sRTP_PKT_NODE * get_multi_pkt_chain(
-    sH264_TO_RTP_CBLK  *cblk,
-    unsigned char      *h264_frame,
-    unsigned int        h264_frame_len
+    const sSX_SEG      *h264_frame,
+    unsigned int        h264_frame_len,
+    unsigned char       au_end
     )
 {
     unsigned int    bytes_remaining; 
     unsigned char   nri; 
     unsigned char   nal_type; 
     unsigned char   marker_bit_set; 
-    unsigned int    curr_index; 
+    unsigned char   nal_header; 
+    sSX_SEG_CURSOR  cursor; 
     unsigned int    pkt_size_left; 
     unsigned char   pos; 
     unsigned int    bytes_to_copy; 
@@ -123,18 +158,19 @@ static sRTP_PKT_NODE * get_multi_pkt_chain(
     sRTP_PKT_NODE  *head; 
 
 
+    // Read the NAL header, the cursor then sits on the payload. 
+    sx_seg_cursor_init(&cursor, h264_frame); 
+    sx_seg_read(&cursor, &nal_header, 1); 
+
     // Extract NRI. 
-    nri         = (h264_frame[0] & 0x60) >> 5; 
+    nri         = (nal_header & 0x60) >> 5; 
 
     // Extract NAL type. 
-    nal_type    = (h264_frame[0] & 0x1f); 
+    nal_type    = (nal_header & 0x1f); 
 
     // Header is parsed. 
     bytes_remaining = h264_frame_len - 1; 
 
-    // Header is parsed. 
-    curr_index = 1; 
-
     do
     {
         // Bytes left in pkt. 
@@ -176,8 +212,8 @@ static sRTP_PKT_NODE * get_multi_pkt_chain(
             node = node->next; 
         }
 
-        // Set RTP header. 
-        rtp_header_set(cblk, &node->rtp_pkt.header, marker_bit_set);
+        // Set RTP header, marker on the last fragment of the access unit. 
+        rtp_header_set(&node->rtp_pkt.header, marker_bit_set && au_end);
 
         // Set FUA unit header.
         h264_fua_header_set(&node->rtp_pkt.payload.bytes[0], 
@@ -193,15 +229,12 @@ static sRTP_PKT_NODE * get_multi_pkt_chain(
             pkt_size_left : bytes_remaining; 
 
         // Copy payload. 
-        memcpy(&node->rtp_pkt.payload.bytes[2], 
-                &h264_frame[curr_index], 
-                bytes_to_copy); 
+        sx_seg_read(&cursor, 
+                    &node->rtp_pkt.payload.bytes[2], 
+                    bytes_to_copy); 
 
         node->rtp_pkt_len = sizeof(sRTP_HEADER) + 2 + bytes_to_copy; 
 
-        // Advance h264 frame index. 
-        curr_index += bytes_to_copy; 
-
         // Decrement bytes to copy. 
         bytes_remaining -= bytes_to_copy; 
 
@@ -215,10 +248,15 @@ void * sx_nal_to_rtp_util_create(
     void
     )
 {
-    void  *cblk = malloc(sizeof(sH264_TO_RTP_CBLK));
+    sH264_TO_RTP_CBLK  *cblk = malloc(sizeof(sH264_TO_RTP_CBLK));
 
     memset(cblk, 0, sizeof(sH264_TO_RTP_CBLK));
 
+    cblk->timestamp_offset = rand(); 
+
+    // rand() gives 31 bits, fold in a second draw for the top one. 
+    cblk->ssrc = ((unsigned int) rand() << 1) ^ (unsigned int) rand(); 
+
     return cblk;
 }
 
@@ -230,24 +268,287 @@ void sx_nal_to_rtp_util_destroy(
 }
 
 
-// Get chain. 
+// --------------------------------------------------------
+// sx_nal_to_rtp_util_packetize
+//      Fragment a NAL unit into RTP packets without a session.
+//      Sequence numbers and timestamps are left 0, the chain can
+//      be shared read-only by every session sending the unit, see
+//      sx_nal_to_rtp_util_header_stamp().
+//
+sRTP_PKT_NODE * sx_nal_to_rtp_util_packetize(
+    const sSX_SEG      *h264_frame, 
+    unsigned int        h264_frame_len,
+    unsigned char       au_end
+    )
+{
+    if(h264_frame_len <= RTP_PAYLOAD_SIZE)
+    {
+        // Single packet. 
+        return get_single_pkt_chain(h264_frame, h264_frame_len, au_end);
+    }
+
+    // Multi packet chain. 
+    return get_multi_pkt_chain(h264_frame, h264_frame_len, au_end);
+}
+
+
+// Point a described packet's payload at the next len bytes. 
+static void desc_payload_map(
+    sRTP_PKT_DESC      *desc, 
+    sSX_SEG_CURSOR     *cursor, 
+    unsigned int        len
+    )
+{
+    unsigned int    mapped; 
+    unsigned int    i; 
+
+
+    desc->seg_count = sx_seg_map(cursor, desc->segs, RTP_DESC_SEGS_MAX, len); 
+
+    mapped = 0; 
+    for(i = 0; i < desc->seg_count; i++)
+    {
+        mapped += desc->segs[i].iov_len; 
+    }
+
+    // Short segments would need more pieces. 
+    assert(mapped == len); 
+}
+
+
+// --------------------------------------------------------
+// sx_nal_to_rtp_util_describe
+//      Fragment a NAL unit like sx_nal_to_rtp_util_packetize(),
+//      but leave the payload where it is: each packet carries
+//      its header and FU-A bytes, and iovecs into the unit's
+//      segments. Nothing is copied, the unit must be kept until
+//      the chain is freed. One allocation for all packets.
+//
+sRTP_PKT_DESC * sx_nal_to_rtp_util_describe(
+    const sSX_SEG      *h264_frame, 
+    unsigned int        h264_frame_len,
+    unsigned char       au_end
+    )
+{
+    sRTP_PKT_DESC  *descs; 
+    sRTP_PKT_DESC  *desc; 
+    sSX_SEG_CURSOR  cursor; 
+    unsigned int    bytes_remaining; 
+    unsigned int    bytes_to_map; 
+    unsigned int    count; 
+    unsigned int    i; 
+    unsigned char   nal_header; 
+    unsigned char   pos; 
+
+
+    sx_seg_cursor_init(&cursor, h264_frame); 
+
+    if(h264_frame_len <= RTP_PAYLOAD_SIZE)
+    {
+        // Single packet, NAL header and all. 
+        desc = malloc(sizeof(sRTP_PKT_DESC)); 
+
+        desc->next      = NULL; 
+        desc->fu_len    = 0; 
+
+        desc_payload_map(desc, &cursor, h264_frame_len); 
+
+        rtp_header_set(&desc->header, au_end); 
+
+        desc->rtp_pkt_len = sizeof(sRTP_HEADER) + h264_frame_len; 
+
+        return desc; 
+    }
+
+    // The NAL header is folded into the FU-A bytes. 
+    sx_seg_read(&cursor, &nal_header, 1); 
+
+    bytes_remaining = h264_frame_len - 1; 
+
+    count = (bytes_remaining + RTP_PAYLOAD_SIZE - 2 - 1) / (RTP_PAYLOAD_SIZE - 2); 
+
+    descs = malloc(count * sizeof(sRTP_PKT_DESC)); 
+
+    for(i = 0; i < count; i++)
+    {
+        desc = &descs[i]; 
+
+        bytes_to_map = (bytes_remaining < RTP_PAYLOAD_SIZE - 2) ? 
+            bytes_remaining : RTP_PAYLOAD_SIZE - 2; 
+
+        pos = FUA_FRAGMENT_MIDDLE; 
+        if(i == 0)
+        {
+            pos = FUA_FRAGMENT_START; 
+        }
+        else if(i == count - 1)
+        {
+            pos = FUA_FRAGMENT_END; 
+        }
+
+        desc->next = (i + 1 < count) ? &descs[i + 1] : NULL; 
+
+        // Marker on the last fragment of the access unit. 
+        rtp_header_set(&desc->header, (i == count - 1) && au_end); 
+
+        h264_fua_header_set(desc->fu, (nal_header & 0x60) >> 5, pos, nal_header & 0x1f); 
+
+        desc->fu_len    = 2; 
+
+        desc_payload_map(desc, &cursor, bytes_to_map); 
+
+        desc->rtp_pkt_len = sizeof(sRTP_HEADER) + 2 + bytes_to_map; 
+
+        bytes_remaining -= bytes_to_map; 
+    }
+
+    return descs; 
+}
+
+
+// --------------------------------------------------------
+// sx_nal_to_rtp_util_desc_iov
+//      Lay a described packet out behind the session's header
+//      hdr, in at most RTP_DESC_IOV_MAX iovecs. Returns the
+//      iovecs used.
+//
+unsigned int sx_nal_to_rtp_util_desc_iov(
+    const sRTP_PKT_DESC    *desc,
+    const sRTP_HEADER      *hdr,
+    struct iovec           *iov
+    )
+{
+    unsigned int    count; 
+    unsigned int    i; 
+
+
+    count = 0; 
+
+    iov[count].iov_base = (void *) hdr; 
+    iov[count].iov_len  = sizeof(sRTP_HEADER); 
+    count++; 
+
+    if(desc->fu_len != 0)
+    {
+        iov[count].iov_base = (void *) desc->fu; 
+        iov[count].iov_len  = desc->fu_len; 
+        count++; 
+    }
+
+    for(i = 0; i < desc->seg_count; i++)
+    {
+        iov[count++] = desc->segs[i]; 
+    }
+
+    return count; 
+}
+
+
+// A described chain is one allocation. 
+void sx_nal_to_rtp_util_desc_free(
+    sRTP_PKT_DESC      *head
+    )
+{
+    free(head); 
+}
+
+
+// RTP timestamp of a capture time in the session's timebase. 
+unsigned int sx_nal_to_rtp_util_timestamp_get(
+    void               *arg,
+    unsigned long long  pts
+    )
+{
+    return rtp_timestamp_get(arg, pts); 
+}
+
+
+// --------------------------------------------------------
+// sx_nal_to_rtp_util_header_stamp
+//      Build the session's header for a shared packet in hdr:
+//      the packet's header with the session's next sequence
+//      number, the given timestamp and its SSRC.
+//
+void sx_nal_to_rtp_util_header_stamp(
+    void               *arg,
+    const sRTP_HEADER  *shared,
+    unsigned int        timestamp,
+    sRTP_HEADER        *hdr
+    )
+{
+    *hdr = *shared; 
+
+    rtp_header_stamp(arg, hdr, timestamp); 
+}
+
+
+// --------------------------------------------------------
+// sx_nal_to_rtp_util_sequence_rewind
+//      Give back the last count sequence numbers stamped, for
+//      packets that were never sent. They are stamped again, so
+//      the receiver sees no gap.
+//
+void sx_nal_to_rtp_util_sequence_rewind(
+    void               *arg,
+    unsigned int        count
+    )
+{
+    sH264_TO_RTP_CBLK  *cblk; 
+
+
+    cblk = arg; 
+
+    cblk->sequence_number -= count; 
+}
+
+
+// Get a chain stamped for one session. 
 sRTP_PKT_NODE * sx_nal_to_rtp_util_get(
-    void           *arg,
-    unsigned char  *h264_frame, 
-    unsigned int    h264_frame_len
+    void               *arg,
+    const sSX_SEG      *h264_frame, 
+    unsigned int        h264_frame_len,
+    unsigned long long  pts,
+    unsigned char       au_end
     )
 {
     sH264_TO_RTP_CBLK  *cblk = arg;
+    sRTP_PKT_NODE      *head; 
+    sRTP_PKT_NODE      *node; 
 
 
-    if(h264_frame_len <= RTP_PAYLOAD_SIZE)
+    // Every packet of the access unit shares its capture time. 
+    cblk->timestamp = rtp_timestamp_get(cblk, pts); 
+
+    head = sx_nal_to_rtp_util_packetize(h264_frame, h264_frame_len, au_end); 
+
+    for(node = head; node != NULL; node = node->next)
     {
-        // Single packet. 
-        return get_single_pkt_chain(cblk, h264_frame, h264_frame_len);
+        rtp_header_stamp(cblk, &node->rtp_pkt.header, cblk->timestamp); 
     }
 
-    // Multi packet chain. 
-    return get_multi_pkt_chain(cblk, h264_frame, h264_frame_len);
+    return head; 
+}
+
+
+// --------------------------------------------------------
+// sx_nal_to_rtp_util_clock_map_get
+//      Pair the current NTP wallclock with the RTP timestamp
+//      of the same instant, as an RTCP sender report does.
+//
+void sx_nal_to_rtp_util_clock_map_get(
+    void               *arg,
+    sRTP_CLOCK_MAP     *map
+    )
+{
+    sH264_TO_RTP_CBLK  *cblk = arg;
+    unsigned long long  now;
+
+
+    now = sx_clock_mono_us(); 
+
+    sx_clock_ntp_get(now, &map->ntp_sec, &map->ntp_frac); 
+
+    map->rtp_timestamp = rtp_timestamp_get(cblk, now); 
 }
  
 
@@ -269,3 +570,146 @@ sRTP_PKT_NODE * sx_nal_to_rtp_util_get(
 
      } while(node != NULL); 
  }
+
+
+// Seconds since start. 
+static double bench_seconds(
+    const struct timespec  *start
+    )
+{
+    struct timespec now;
+
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
+// --------------------------------------------------------
+// sx_nal_to_rtp_benchmark
+//      Packetize a large NAL unit for sessions receivers, once
+//      per session as sx_nal_to_rtp_util_get() does, then once in
+//      total with a header stamped per session and packet, then
+//      described in place with iovecs per session and packet, and
+//      log the throughput of each.
+//
+void sx_nal_to_rtp_benchmark(
+    unsigned int    sessions,
+    unsigned int    iterations
+    )
+{
+    unsigned char      *data;
+    sSX_SEG             seg;
+    void              **instances;
+    sRTP_PKT_NODE      *head;
+    sRTP_PKT_NODE      *node;
+    sRTP_PKT_DESC      *descs;
+    sRTP_PKT_DESC      *desc;
+    sRTP_HEADER         hdr;
+    struct iovec        iov[RTP_DESC_IOV_MAX];
+    struct timespec     start;
+    double              per_session_sec;
+    double              shared_sec;
+    double              described_sec;
+    unsigned int        timestamp;
+    unsigned int        check;
+    unsigned int        i;
+    unsigned int        j;
+
+
+    assert(sessions > 0);
+    assert(iterations > 0);
+
+    data = malloc(RTP_BENCH_NAL_LEN);
+    memset(data, 0x5a, RTP_BENCH_NAL_LEN);
+    data[0] = 0x41;
+
+    sx_seg_init(&seg, data, RTP_BENCH_NAL_LEN);
+    seg.len = RTP_BENCH_NAL_LEN;
+
+    instances = malloc(sessions * sizeof(void *));
+    for(j = 0; j < sessions; j++)
+    {
+        instances[j] = sx_nal_to_rtp_util_create();
+    }
+
+    check = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(i = 0; i < iterations; i++)
+    {
+        for(j = 0; j < sessions; j++)
+        {
+            head = sx_nal_to_rtp_util_get(instances[j], &seg, RTP_BENCH_NAL_LEN, i, 1);
+
+            check += head->rtp_pkt.header.sequence_number;
+
+            sx_nal_to_rtp_util_free(head);
+        }
+    }
+    per_session_sec = bench_seconds(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(i = 0; i < iterations; i++)
+    {
+        head = sx_nal_to_rtp_util_packetize(&seg, RTP_BENCH_NAL_LEN, 1);
+
+        for(j = 0; j < sessions; j++)
+        {
+            timestamp = sx_nal_to_rtp_util_timestamp_get(instances[j], i);
+
+            for(node = head; node != NULL; node = node->next)
+            {
+                sx_nal_to_rtp_util_header_stamp(instances[j], &node->rtp_pkt.header, timestamp, &hdr);
+
+                check += hdr.sequence_number;
+            }
+        }
+
+        sx_nal_to_rtp_util_free(head);
+    }
+    shared_sec = bench_seconds(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(i = 0; i < iterations; i++)
+    {
+        descs = sx_nal_to_rtp_util_describe(&seg, RTP_BENCH_NAL_LEN, 1);
+
+        for(j = 0; j < sessions; j++)
+        {
+            timestamp = sx_nal_to_rtp_util_timestamp_get(instances[j], i);
+
+            for(desc = descs; desc != NULL; desc = desc->next)
+            {
+                sx_nal_to_rtp_util_header_stamp(instances[j], &desc->header, timestamp, &hdr);
+
+                check += hdr.sequence_number + sx_nal_to_rtp_util_desc_iov(desc, &hdr, iov);
+            }
+        }
+
+        sx_nal_to_rtp_util_desc_free(descs);
+    }
+    described_sec = bench_seconds(&start);
+
+    for(j = 0; j < sessions; j++)
+    {
+        sx_nal_to_rtp_util_destroy(instances[j]);
+    }
+
+    free(instances);
+    free(data);
+
+    logger_log("(nal_to_rtp): %d byte NAL unit x %d, %d sessions (check %x)",
+               RTP_BENCH_NAL_LEN,
+               iterations,
+               sessions,
+               check);
+
+    logger_log("(nal_to_rtp): per session = %.1f MB/s, shared = %.1f MB/s (x%.1f), described = %.1f MB/s (x%.1f)",
+               (double) RTP_BENCH_NAL_LEN * iterations * sessions / per_session_sec / 1e6,
+               (double) RTP_BENCH_NAL_LEN * iterations * sessions / shared_sec / 1e6,
+               per_session_sec / shared_sec,
+               (double) RTP_BENCH_NAL_LEN * iterations * sessions / described_sec / 1e6,
+               per_session_sec / described_sec);
+}
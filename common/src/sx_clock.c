@@ -0,0 +1,49 @@
+#include <time.h>
+
+#include "sx_clock.h"
+
+
+// --------------------------------------------------------
+// sx_clock_mono_us
+//      Current CLOCK_MONOTONIC time in microseconds. Capture
+//      timestamps use this timebase.
+//
+unsigned long long sx_clock_mono_us(
+    void
+    )
+{
+    struct timespec now;
+
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * SX_CLOCK_US_PER_SEC + now.tv_nsec / 1000;
+}
+
+
+// --------------------------------------------------------
+// sx_clock_ntp_get
+//      Map a monotonic time to NTP wallclock (RFC 5905 64 bit
+//      format), using the current wallclock offset. Steps of
+//      the wallclock show up here and nowhere else.
+//
+void sx_clock_ntp_get(
+    unsigned long long  mono_us,
+    unsigned int       *ntp_sec,
+    unsigned int       *ntp_frac
+    )
+{
+    struct timespec     wall;
+    unsigned long long  wall_us;
+
+
+    clock_gettime(CLOCK_REALTIME, &wall);
+
+    wall_us = wall.tv_sec * SX_CLOCK_US_PER_SEC + wall.tv_nsec / 1000;
+
+    // Shift by the age of mono_us, which may also lie ahead.
+    wall_us += (long long) (mono_us - sx_clock_mono_us());
+
+    *ntp_sec    = (unsigned int) (wall_us / SX_CLOCK_US_PER_SEC) + SX_CLOCK_NTP_UNIX_OFFSET;
+    *ntp_frac   = (unsigned int) (((wall_us % SX_CLOCK_US_PER_SEC) << 32) / SX_CLOCK_US_PER_SEC);
+}
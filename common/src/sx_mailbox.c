@@ -0,0 +1,454 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <assert.h>
+
+#include "logger.h"
+#include "sx_mailbox.h"
+
+
+// Lane cell. seq tells producers and the consumer whose turn the cell
+// is: pos when free for the producer claiming slot pos, pos + 1 once
+// that producer has filled it.
+typedef struct
+{
+    unsigned int    seq;            ///< Turn.
+    unsigned int    pad;            ///< Keeps msg 8 byte aligned.
+    unsigned char   msg[];          ///< Message copy.
+
+} sMAILBOX_CELL;
+
+
+// Bounded multi-producer, single consumer ring.
+typedef struct
+{
+    unsigned int    enqueue_pos __attribute__((aligned(64)));  ///< Next slot to claim, producers CAS it.
+    unsigned int    dequeue_pos __attribute__((aligned(64)));  ///< Next slot to read, consumer owned.
+    unsigned char  *cells __attribute__((aligned(64)));        ///< lane_size cells of cell_size bytes.
+
+} sMAILBOX_LANE;
+
+
+typedef struct
+{
+    sMAILBOX_LANE       lanes[SX_MAILBOX_LANE_NUM];     ///< Control lane first.
+
+    unsigned int        msg_size;   ///< Message size (bytes).
+    unsigned int        cell_size;  ///< Cell size (bytes).
+    unsigned int        mask;       ///< Lane size - 1.
+
+    int                 event_fd;   ///< Receiver wakeup.
+    int                 sleeping;   ///< Receiver is (about to be) blocked on event_fd.
+
+    sSX_MAILBOX_STATS   stats;      ///< Counters, updated atomically.
+
+} sMAILBOX;
+
+
+static sMAILBOX_CELL * cell_get(
+    sMAILBOX       *mailbox,
+    sMAILBOX_LANE  *lane,
+    unsigned int    pos
+    )
+{
+    return (sMAILBOX_CELL *) (lane->cells + (pos & mailbox->mask) * mailbox->cell_size);
+}
+
+
+// --------------------------------------------------------
+// sx_mailbox_create
+//      Create a mailbox for msg_size byte messages, each lane
+//      holding at least lane_size of them.
+//
+SX_MAILBOX sx_mailbox_create(
+    unsigned int    msg_size,
+    unsigned int    lane_size
+    )
+{
+    sMAILBOX       *mailbox;
+    unsigned int    size;
+    unsigned int    i;
+    unsigned int    pos;
+    int             rv;
+
+
+    assert((lane_size > 0) && (lane_size <= 0x10000));
+
+    size = 2;
+    while(size < lane_size)
+    {
+        size <<= 1;
+    }
+
+    rv = posix_memalign((void **) &mailbox, 64, sizeof(sMAILBOX));
+    assert(rv == 0);
+
+    memset(mailbox, 0, sizeof(sMAILBOX));
+
+    mailbox->msg_size   = msg_size;
+    mailbox->cell_size  = (sizeof(sMAILBOX_CELL) + msg_size + 7) & ~7;
+    mailbox->mask       = size - 1;
+
+    for(i = 0; i < SX_MAILBOX_LANE_NUM; i++)
+    {
+        mailbox->lanes[i].cells = malloc(size * mailbox->cell_size);
+
+        for(pos = 0; pos < size; pos++)
+        {
+            cell_get(mailbox, &mailbox->lanes[i], pos)->seq = pos;
+        }
+    }
+
+    // Counts wakeups, read blocks while it is 0.
+    mailbox->event_fd = eventfd(0, EFD_CLOEXEC);
+    assert(mailbox->event_fd >= 0);
+
+    return mailbox;
+}
+
+
+// Claim a cell, copy the message in and publish it. Returns 0 if the
+// lane is full.
+static unsigned char lane_push(
+    sMAILBOX       *mailbox,
+    sMAILBOX_LANE  *lane,
+    const void     *msg
+    )
+{
+    sMAILBOX_CELL  *cell;
+    unsigned int    pos;
+    unsigned int    seq;
+    int             dif;
+
+
+    pos = __atomic_load_n(&lane->enqueue_pos, __ATOMIC_RELAXED);
+
+    while(1)
+    {
+        cell    = cell_get(mailbox, lane, pos);
+        seq     = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        dif     = (int) (seq - pos);
+
+        if(dif == 0)
+        {
+            // Free for slot pos, try to claim it.
+            if(__atomic_compare_exchange_n(&lane->enqueue_pos,
+                                           &pos,
+                                           pos + 1,
+                                           1,
+                                           __ATOMIC_RELAXED,
+                                           __ATOMIC_RELAXED))
+            {
+                break;
+            }
+
+            // Lost the race, pos now holds the current value.
+        }
+        else if(dif < 0)
+        {
+            // Still holds the message from a lap ago.
+            return 0;
+        }
+        else
+        {
+            pos = __atomic_load_n(&lane->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    memcpy(cell->msg, msg, mailbox->msg_size);
+
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+
+// Take the oldest message of a lane. Returns 0 if it is empty.
+static unsigned char lane_pull(
+    sMAILBOX       *mailbox,
+    sMAILBOX_LANE  *lane,
+    void           *msg
+    )
+{
+    sMAILBOX_CELL  *cell;
+    unsigned int    pos;
+
+
+    pos     = lane->dequeue_pos;
+    cell    = cell_get(mailbox, lane, pos);
+
+    if(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1)
+    {
+        // Empty, or claimed but not yet filled.
+        return 0;
+    }
+
+    memcpy(msg, cell->msg, mailbox->msg_size);
+
+    lane->dequeue_pos = pos + 1;
+
+    // Free for the producer one lap ahead.
+    __atomic_store_n(&cell->seq, pos + mailbox->mask + 1, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+
+// --------------------------------------------------------
+// sx_mailbox_send
+//      Copy a message into a lane, from any thread. Wakes the
+//      receiver only if it is blocked, otherwise no syscall.
+//
+void sx_mailbox_send(
+    SX_MAILBOX          mailbox_id,
+    eSX_MAILBOX_LANE    lane,
+    const void         *msg
+    )
+{
+    sMAILBOX           *mailbox;
+    unsigned long long  one;
+    int                 rv;
+
+
+    mailbox = mailbox_id;
+
+    assert(lane < SX_MAILBOX_LANE_NUM);
+
+    if(!lane_push(mailbox, &mailbox->lanes[lane], msg))
+    {
+        // Lanes are sized for the worst case, this is a receiver that
+        // stopped receiving. Wait for it rather than lose the message.
+        __atomic_fetch_add(&mailbox->stats.full_count, 1, __ATOMIC_RELAXED);
+
+        do
+        {
+            sched_yield();
+
+        } while(!lane_push(mailbox, &mailbox->lanes[lane], msg));
+    }
+
+    __atomic_fetch_add(&mailbox->stats.send_count[lane], 1, __ATOMIC_RELAXED);
+
+    // Pairs with the fence in sx_mailbox_recv(): either the receiver
+    // sees the message before it sleeps, or we see it sleeping.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if(   __atomic_load_n(&mailbox->sleeping, __ATOMIC_RELAXED)
+       && __atomic_exchange_n(&mailbox->sleeping, 0, __ATOMIC_RELAXED))
+    {
+        __atomic_fetch_add(&mailbox->stats.wakeup_count, 1, __ATOMIC_RELAXED);
+
+        one = 1;
+
+        rv = write(mailbox->event_fd, &one, sizeof(one));
+        assert(rv == sizeof(one));
+    }
+}
+
+
+// --------------------------------------------------------
+// sx_mailbox_try_recv
+//      Receiver side. Take the next message, control lane first.
+//      Returns 0 if there is none.
+//
+unsigned char sx_mailbox_try_recv(
+    SX_MAILBOX          mailbox_id,
+    void               *msg
+    )
+{
+    sMAILBOX       *mailbox;
+    unsigned int    i;
+
+
+    mailbox = mailbox_id;
+
+    for(i = 0; i < SX_MAILBOX_LANE_NUM; i++)
+    {
+        if(lane_pull(mailbox, &mailbox->lanes[i], msg))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+// --------------------------------------------------------
+// sx_mailbox_recv_wait
+//      Receiver side. Take the next message, control lane first,
+//      waiting up to timeout_us (SX_MAILBOX_WAIT_FOREVER for no
+//      limit) for one.
+//
+//      Returns 0 on timeout, or early if the wakeup was for a
+//      message already taken.
+//
+unsigned char sx_mailbox_recv_wait(
+    SX_MAILBOX          mailbox_id,
+    void               *msg,
+    unsigned int        timeout_us
+    )
+{
+    sMAILBOX           *mailbox;
+    struct pollfd       pfd;
+    struct timespec     timeout;
+    unsigned long long  count;
+    int                 rv;
+
+
+    mailbox = mailbox_id;
+
+    if(sx_mailbox_try_recv(mailbox, msg))
+    {
+        return 1;
+    }
+
+    __atomic_store_n(&mailbox->sleeping, 1, __ATOMIC_RELAXED);
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    // A send that missed the flag must be visible now.
+    if(sx_mailbox_try_recv(mailbox, msg))
+    {
+        __atomic_store_n(&mailbox->sleeping, 0, __ATOMIC_RELAXED);
+
+        return 1;
+    }
+
+    pfd.fd      = mailbox->event_fd;
+    pfd.events  = POLLIN;
+
+    timeout.tv_sec  = timeout_us / 1000000;
+    timeout.tv_nsec = (timeout_us % 1000000) * 1000;
+
+    rv = ppoll(&pfd, 1, (timeout_us == SX_MAILBOX_WAIT_FOREVER) ? NULL : &timeout, NULL);
+    if(rv > 0)
+    {
+        // The sender cleared the flag.
+        rv = read(mailbox->event_fd, &count, sizeof(count));
+        assert(rv == sizeof(count));
+    }
+    else
+    {
+        // Timed out. A sender taking the flag from here on leaves a
+        // count behind, the next wait returns early for it.
+        __atomic_store_n(&mailbox->sleeping, 0, __ATOMIC_RELAXED);
+    }
+
+    return sx_mailbox_try_recv(mailbox, msg);
+}
+
+
+// --------------------------------------------------------
+// sx_mailbox_recv
+//      Receiver side. Take the next message, control lane first,
+//      blocking until there is one.
+//
+void sx_mailbox_recv(
+    SX_MAILBOX          mailbox,
+    void               *msg
+    )
+{
+    while(!sx_mailbox_recv_wait(mailbox, msg, SX_MAILBOX_WAIT_FOREVER))
+    {
+    }
+}
+
+
+// --------------------------------------------------------
+// sx_mailbox_poll
+//      Receiver side, for event loops. Take the next message,
+//      control lane first. When there is none, arm the wakeup:
+//      the next send makes sx_mailbox_fd_get() readable.
+//
+//      Returns 0 once armed.
+//
+unsigned char sx_mailbox_poll(
+    SX_MAILBOX          mailbox_id,
+    void               *msg
+    )
+{
+    sMAILBOX       *mailbox;
+
+
+    mailbox = mailbox_id;
+
+    if(sx_mailbox_try_recv(mailbox, msg))
+    {
+        return 1;
+    }
+
+    __atomic_store_n(&mailbox->sleeping, 1, __ATOMIC_RELAXED);
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    // Same handshake as sx_mailbox_recv_wait().
+    if(sx_mailbox_try_recv(mailbox, msg))
+    {
+        __atomic_store_n(&mailbox->sleeping, 0, __ATOMIC_RELAXED);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+
+// --------------------------------------------------------
+// sx_mailbox_fd_get
+//      Receiver wakeup eventfd, readable after a send to a
+//      mailbox armed by sx_mailbox_poll(). Read its 8 byte count
+//      before polling again. A wakeup may find nothing waiting.
+//
+int sx_mailbox_fd_get(
+    SX_MAILBOX          mailbox
+    )
+{
+    return ((sMAILBOX *) mailbox)->event_fd;
+}
+
+
+void sx_mailbox_stats_get(
+    SX_MAILBOX          mailbox_id,
+    sSX_MAILBOX_STATS  *stats
+    )
+{
+    sMAILBOX       *mailbox;
+    unsigned int    i;
+
+
+    mailbox = mailbox_id;
+
+    for(i = 0; i < SX_MAILBOX_LANE_NUM; i++)
+    {
+        stats->send_count[i] = __atomic_load_n(&mailbox->stats.send_count[i], __ATOMIC_RELAXED);
+    }
+
+    stats->wakeup_count = __atomic_load_n(&mailbox->stats.wakeup_count, __ATOMIC_RELAXED);
+    stats->full_count   = __atomic_load_n(&mailbox->stats.full_count, __ATOMIC_RELAXED);
+}
+
+
+void sx_mailbox_stats_log(
+    SX_MAILBOX          mailbox,
+    const char         *name
+    )
+{
+    sSX_MAILBOX_STATS   stats;
+
+
+    sx_mailbox_stats_get(mailbox, &stats);
+
+    logger_log("(sx_mailbox): %s: control = %d, data = %d, wakeups = %d, full = %d",
+               name,
+               stats.send_count[SX_MAILBOX_LANE_CONTROL],
+               stats.send_count[SX_MAILBOX_LANE_DATA],
+               stats.wakeup_count,
+               stats.full_count);
+}
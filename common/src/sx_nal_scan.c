@@ -0,0 +1,418 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SX_NAL_SCAN_NEON
+#endif
+
+#include "logger.h"
+#include "sx_nal_scan.h"
+
+// Bytes a vector step looks at: 16 positions plus the two bytes that
+// complete a start code beginning at the last one.
+#define NAL_SCAN_VECTOR         16
+#define NAL_SCAN_LOOKAHEAD      (NAL_SCAN_VECTOR + 2)
+
+#define NAL_SCAN_BENCH_SEED     0x5eed
+#define NAL_SCAN_BENCH_NAL_LEN  8192
+
+
+// --------------------------------------------------------
+// sx_nal_scan_bytewise
+//      Reference scanner, one byte per step. Returns the first
+//      byte of the next 00 00 01, or end if there is none.
+//
+const unsigned char * sx_nal_scan_bytewise(
+    const unsigned char    *data,
+    const unsigned char    *end
+    )
+{
+    const unsigned char *curr;
+
+
+    for(curr = data; curr + 3 <= end; curr++)
+    {
+        if((curr[0] == 0x00) && (curr[1] == 0x00) && (curr[2] == 0x01))
+        {
+            return curr;
+        }
+    }
+
+    return end;
+}
+
+
+// --------------------------------------------------------
+// sx_nal_scan
+//      Find the next 00 00 01 start code, 16 positions per step
+//      with SSE2 or NEON, falling back to the byte-wise scanner
+//      when neither is available and for the tail.
+//
+const unsigned char * sx_nal_scan(
+    const unsigned char    *data,
+    const unsigned char    *end
+    )
+{
+    const unsigned char *curr;
+
+
+    curr = data;
+
+#if defined(__SSE2__)
+    {
+        const __m128i   zero = _mm_setzero_si128();
+        const __m128i   one  = _mm_set1_epi8(1);
+        __m128i         hit;
+        int             mask;
+
+
+        while(curr + NAL_SCAN_LOOKAHEAD <= end)
+        {
+            // Position i is a start code when bytes i, i + 1 and i + 2
+            // are 00, 00 and 01. Compare three shifted loads, no false hits.
+            hit = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (curr + 0)), zero),
+                                _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (curr + 1)), zero));
+            hit = _mm_and_si128(hit,
+                                _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (curr + 2)), one));
+
+            mask = _mm_movemask_epi8(hit);
+            if(mask != 0)
+            {
+                return curr + __builtin_ctz(mask);
+            }
+
+            curr += NAL_SCAN_VECTOR;
+        }
+    }
+#elif defined(SX_NAL_SCAN_NEON)
+    {
+        const uint8x16_t    zero = vdupq_n_u8(0);
+        const uint8x16_t    one  = vdupq_n_u8(1);
+        uint8x16_t          hit;
+        uint8x8_t           fold;
+
+
+        while(curr + NAL_SCAN_LOOKAHEAD <= end)
+        {
+            hit = vandq_u8(vceqq_u8(vld1q_u8(curr + 0), zero),
+                           vceqq_u8(vld1q_u8(curr + 1), zero));
+            hit = vandq_u8(hit, vceqq_u8(vld1q_u8(curr + 2), one));
+
+            // No movemask on NEON, fold to 64 bits to test for any hit.
+            fold = vorr_u8(vget_low_u8(hit), vget_high_u8(hit));
+            if(vget_lane_u64(vreinterpret_u64_u8(fold), 0) != 0)
+            {
+                // Exactly one of these 16 positions matches first.
+                return sx_nal_scan_bytewise(curr, curr + NAL_SCAN_LOOKAHEAD);
+            }
+
+            curr += NAL_SCAN_VECTOR;
+        }
+    }
+#endif
+
+    return sx_nal_scan_bytewise(curr, end);
+}
+
+
+// --------------------------------------------------------
+// sx_nal_au_start
+//      Does this NAL unit open a new access unit? (H.264 7.4.1.2.3)
+//      Slices with first_mb_in_slice == 0 do once the current
+//      access unit has a slice, as do SEI, SPS, PPS and AUD. So
+//      does the first of these in the stream.
+//
+unsigned char sx_nal_au_start(
+    sSX_NAL_AU             *au,
+    const unsigned char    *nal,
+    unsigned int            nal_len
+    )
+{
+    unsigned char   nal_type;
+    unsigned char   start;
+
+
+    if(nal_len == 0)
+    {
+        return 0;
+    }
+
+    nal_type = nal[0] & 0x1F;
+
+    switch(nal_type)
+    {
+        case 1:
+        case 5:
+        {
+            // ue(v) of 0 is a single '1' bit.
+            start = (au->vcl_seen || !au->started) && (nal_len > 1) && (nal[1] & 0x80);
+
+            au->vcl_seen    = 1;
+            au->started     = 1;
+
+            return start;
+        }
+        case 6:
+        case 7:
+        case 8:
+        case 9:
+        {
+            start = au->vcl_seen || !au->started;
+
+            au->vcl_seen    = 0;
+            au->started     = 1;
+
+            return start;
+        }
+        default:
+        {
+            return 0;
+        }
+    }
+}
+
+
+// Drop trailing zeros, they belong to the following 4 byte start code.
+static unsigned int nal_trim(
+    const unsigned char    *nal,
+    unsigned int            nal_len
+    )
+{
+    while((nal_len > 0) && (nal[nal_len - 1] == 0x00))
+    {
+        nal_len--;
+    }
+
+    return nal_len;
+}
+
+
+// --------------------------------------------------------
+// sx_nal_split
+//      Split an Annex-B buffer into NAL units in one pass. Bytes
+//      before the first start code come back flagged
+//      SX_NAL_FLAG_CONTINUATION. NAL units opening an access unit
+//      are flagged SX_NAL_FLAG_AU_START and the one before them
+//      SX_NAL_FLAG_AU_END. The last NAL unit runs to the end of
+//      data untrimmed, it may continue in the next buffer.
+//
+//      Stops once nals is full and sets used to the start code of
+//      the first NAL unit left, call again from there for the
+//      rest. Otherwise used is len.
+//
+//      Returns the number of entries written to nals.
+//
+unsigned int sx_nal_split(
+    sSX_NAL_AU             *au,
+    unsigned char          *data,
+    unsigned int            len,
+    sSX_NAL                *nals,
+    unsigned int            nals_max,
+    unsigned int           *used
+    )
+{
+    const unsigned char    *end;
+    const unsigned char    *start_code;
+    const unsigned char    *next;
+    unsigned char          *nal;
+    unsigned int            nal_len;
+    unsigned int            count;
+    sSX_NAL_AU              peek;
+
+
+    assert(nals_max > 0);
+
+    end     = data + len;
+    count   = 0;
+    *used   = len;
+
+    start_code = sx_nal_scan(data, end);
+
+    nal_len = nal_trim(data, start_code - data);
+    if((start_code == end) && (len > 0))
+    {
+        // No start code at all, all of it continues the previous NAL.
+        nal_len = len;
+    }
+
+    if(nal_len > 0)
+    {
+        nals[count].nal     = data;
+        nals[count].nal_len = nal_len;
+        nals[count].flags   = SX_NAL_FLAG_CONTINUATION;
+        count++;
+    }
+
+    while(start_code != end)
+    {
+        next        = start_code;
+        nal         = (unsigned char *) start_code + 3;
+        start_code  = sx_nal_scan(nal, end);
+
+        nal_len = start_code - nal;
+        if(start_code != end)
+        {
+            nal_len = nal_trim(nal, nal_len);
+        }
+
+        if(nal_len == 0)
+        {
+            continue;
+        }
+
+        if(count == nals_max)
+        {
+            // Full. Whether this one opens an access unit decides the
+            // last entry's flags, look without moving the tracker on.
+            peek = *au;
+
+            if(sx_nal_au_start(&peek, nal, nal_len))
+            {
+                nals[count - 1].flags |= SX_NAL_FLAG_AU_END;
+            }
+
+            *used = next - data;
+
+            break;
+        }
+
+        nals[count].nal     = nal;
+        nals[count].nal_len = nal_len;
+        nals[count].flags   = 0;
+
+        if(sx_nal_au_start(au, nal, nal_len))
+        {
+            nals[count].flags |= SX_NAL_FLAG_AU_START;
+
+            if(count > 0)
+            {
+                nals[count - 1].flags |= SX_NAL_FLAG_AU_END;
+            }
+        }
+
+        count++;
+    }
+
+    return count;
+}
+
+
+static double bench_seconds(
+    const struct timespec  *start
+    )
+{
+    struct timespec now;
+
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
+// Count start codes in a buffer with the given scanner.
+static unsigned int bench_count(
+    const unsigned char *(*scan)(const unsigned char *, const unsigned char *),
+    const unsigned char    *data,
+    unsigned int            len
+    )
+{
+    const unsigned char    *curr;
+    const unsigned char    *end;
+    unsigned int            count;
+
+
+    end     = data + len;
+    count   = 0;
+
+    for(curr = scan(data, end); curr != end; curr = scan(curr + 3, end))
+    {
+        count++;
+    }
+
+    return count;
+}
+
+
+// --------------------------------------------------------
+// sx_nal_scan_benchmark
+//      Time sx_nal_scan() against sx_nal_scan_bytewise() over a
+//      size byte stream of random slices with a start code every
+//      8 KB, and log the throughput of each.
+//
+void sx_nal_scan_benchmark(
+    unsigned int    size,
+    unsigned int    iterations
+    )
+{
+    unsigned char      *data;
+    unsigned int        seed;
+    unsigned int        i;
+    unsigned int        expected;
+    unsigned int        count;
+    struct timespec     start;
+    double              bytewise_sec;
+    double              vector_sec;
+
+
+    assert(size > 4);
+    assert(iterations > 0);
+
+    data = malloc(size);
+
+    // Random payload, zeros included so the scanners see near misses.
+    seed = NAL_SCAN_BENCH_SEED;
+    for(i = 0; i < size; i++)
+    {
+        data[i] = rand_r(&seed);
+    }
+
+    for(i = 0; i + 4 <= size; i += NAL_SCAN_BENCH_NAL_LEN)
+    {
+        data[i + 0] = 0x00;
+        data[i + 1] = 0x00;
+        data[i + 2] = 0x01;
+        data[i + 3] = 0x41;
+    }
+
+    expected = bench_count(sx_nal_scan_bytewise, data, size);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(i = 0; i < iterations; i++)
+    {
+        count = bench_count(sx_nal_scan_bytewise, data, size);
+    }
+    bytewise_sec = bench_seconds(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(i = 0; i < iterations; i++)
+    {
+        count = bench_count(sx_nal_scan, data, size);
+    }
+    vector_sec = bench_seconds(&start);
+
+    assert(count == expected);
+
+    logger_log("(sx_nal_scan): %d bytes x %d, %d start codes",
+               size,
+               iterations,
+               expected);
+
+    logger_log("(sx_nal_scan): bytewise = %.1f MB/s, %s = %.1f MB/s",
+               (double) size * iterations / bytewise_sec / 1e6,
+#if defined(__SSE2__)
+               "sse2",
+#elif defined(SX_NAL_SCAN_NEON)
+               "neon",
+#else
+               "scalar",
+#endif
+               (double) size * iterations / vector_sec / 1e6);
+
+    free(data);
+}
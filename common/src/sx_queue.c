@@ -1,8 +1,11 @@
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <pthread.h>
 #include <assert.h>
 #include <stdio.h>
 
+#include "logger.h"
 #include "sx_queue.h"
 
 typedef struct sNODE
@@ -18,11 +21,64 @@ typedef struct
     sNODE          *head;
     sNODE          *tail;
     pthread_mutex_t lock;
+    pthread_cond_t  not_full;       ///< Signalled when a pull makes room.
+    pthread_cond_t  not_empty;      ///< Signalled on push while a puller waits.
+    unsigned int    waiters;        ///< Pullers waiting on not_empty.
     unsigned int    len;
 
+    sSX_QUEUE_CONFIG config;        ///< Capacity and overflow policy.
+    unsigned char   skipping;       ///< Dropping pushes until a key entry.
+    sSX_QUEUE_STATS stats;          ///< Counters.
+
 } sQUEUE;
 
 
+static const char * const f_policy_names[] =
+{
+    "block",
+    "drop newest",
+    "drop oldest",
+    "drop to key",
+};
+
+
+// --------------------------------------------------------
+// sx_queue_create_bounded
+//      Create a queue holding at most config->capacity entries,
+//      handling overflow per config->policy.
+//
+SX_QUEUE sx_queue_create_bounded(
+    const sSX_QUEUE_CONFIG *config
+    )
+{
+    sQUEUE             *queue = malloc(sizeof(sQUEUE));
+    pthread_condattr_t  attr;
+
+    assert((config->policy == SX_QUEUE_POLICY_BLOCK) || (config->drop != NULL));
+    assert((config->policy != SX_QUEUE_POLICY_DROP_TO_KEY) || (config->is_key != NULL));
+
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+
+    // Timed waits run on the monotonic clock, immune to clock steps.
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue->not_empty, &attr);
+    pthread_condattr_destroy(&attr);
+
+    queue->head     = NULL;
+    queue->tail     = NULL;
+    queue->waiters  = 0;
+    queue->len      = 0;
+    queue->config   = *config;
+    queue->skipping = 0;
+
+    memset(&queue->stats, 0, sizeof(queue->stats));
+
+    return queue;
+}
+
+
 // --------------------------------------------------------
 // rt_queue_create
 //      Create a queue.
@@ -31,15 +87,16 @@ SX_QUEUE sx_queue_create(
     void
     )
 {
-    sQUEUE *queue = malloc(sizeof(sQUEUE));
+    sSX_QUEUE_CONFIG config;
 
-    pthread_mutex_init(&queue->lock, NULL);
 
-    queue->head = NULL;
-    queue->tail = NULL;
-    queue->len  = 0;
+    memset(&config, 0, sizeof(config));
 
-    return queue;
+    // Unbounded.
+    config.capacity = 0;
+    config.policy   = SX_QUEUE_POLICY_BLOCK;
+
+    return sx_queue_create_bounded(&config);
 }
 
 
@@ -77,22 +134,172 @@ void sx_queue_destroy(
     // Destroy mutex.
     pthread_mutex_destroy(&queue->lock);
 
+    pthread_cond_destroy(&queue->not_full);
+
+    pthread_cond_destroy(&queue->not_empty);
+
     // Free queue.
     free(queue);
 }
 
 
+// Unlink the first count nodes onto the dropped list. Lock held.
+static void nodes_unlink(
+    sQUEUE         *queue,
+    unsigned int    count,
+    sNODE         **dropped
+    )
+{
+    sNODE  *node;
+
+
+    while((count > 0) && (queue->head != NULL))
+    {
+        node        = queue->head;
+        queue->head = node->next;
+
+        node->next  = *dropped;
+        *dropped    = node;
+
+        queue->len--;
+        queue->stats.drop_oldest++;
+
+        count--;
+    }
+
+    if(queue->head == NULL)
+    {
+        queue->tail = NULL;
+    }
+}
+
+
+// Make room in a full queue for data. Lock held. Returns 0 if data
+// must be dropped instead of queued.
+static unsigned char overflow_handle(
+    sQUEUE         *queue,
+    void           *data,
+    sNODE         **dropped
+    )
+{
+    sNODE          *node;
+    int             key_index;
+    int             index;
+
+
+    switch(queue->config.policy)
+    {
+        case SX_QUEUE_POLICY_BLOCK:
+        {
+            queue->stats.block_count++;
+
+            while(queue->len >= queue->config.capacity)
+            {
+                pthread_cond_wait(&queue->not_full, &queue->lock);
+            }
+
+            return 1;
+        }
+        case SX_QUEUE_POLICY_DROP_NEWEST:
+        {
+            return 0;
+        }
+        case SX_QUEUE_POLICY_DROP_OLDEST:
+        {
+            nodes_unlink(queue, 1, dropped);
+
+            return 1;
+        }
+        case SX_QUEUE_POLICY_DROP_TO_KEY:
+        {
+            // Resume from the most recent key entry still queued.
+            key_index = -1;
+            for(node = queue->head, index = 0; node != NULL; node = node->next, index++)
+            {
+                if(queue->config.is_key(queue->config.user_arg, node->data))
+                {
+                    key_index = index;
+                }
+            }
+
+            if(key_index > 0)
+            {
+                nodes_unlink(queue, key_index, dropped);
+
+                return 1;
+            }
+
+            if((key_index == 0) && !queue->config.is_key(queue->config.user_arg, data))
+            {
+                // Already resuming from the head, keep it and skip what
+                // follows until the next key entry.
+                queue->skipping = 1;
+
+                return 0;
+            }
+
+            // Nothing to resume from, or a newer key entry to resume
+            // from, start over at the next key entry.
+            nodes_unlink(queue, queue->len, dropped);
+
+            queue->stats.flush_count++;
+
+            if(queue->config.is_key(queue->config.user_arg, data))
+            {
+                return 1;
+            }
+
+            queue->skipping = 1;
+
+            return 0;
+        }
+        default:
+        {
+            assert(0);
+        }
+    }
+
+    return 0;
+}
+
+
+// Hand dropped entries back to the owner, outside the lock.
+static void nodes_drop(
+    sQUEUE *queue,
+    sNODE  *dropped
+    )
+{
+    sNODE  *next;
+
+
+    while(dropped != NULL)
+    {
+        next = dropped->next;
+
+        queue->config.drop(queue->config.user_arg, dropped->data);
+
+        free(dropped);
+
+        dropped = next;
+    }
+}
+
+
 // --------------------------------------------------------
 // rt_queue_push
-//      Push a data payload.
+//      Push a data payload. A full bounded queue blocks or
+//      drops per its policy.
 //
 void sx_queue_push(
     SX_QUEUE    queue_id,
     void       *data
     )
 {
-    sNODE  *node;
-    sQUEUE *queue;
+    sNODE          *node;
+    sQUEUE         *queue;
+    sNODE          *dropped;
+    unsigned char   skipping;
+    unsigned char   flushed;
 
 
     assert(data != NULL);
@@ -105,9 +312,30 @@ void sx_queue_push(
     node->data = data;
     node->next = NULL;
 
+    dropped = NULL;
+
     // Lock.
     pthread_mutex_lock(&queue->lock);
 
+    skipping = queue->skipping;
+
+    if(queue->skipping)
+    {
+        if(!queue->config.is_key(queue->config.user_arg, data))
+        {
+            goto drop;
+        }
+
+        queue->skipping = 0;
+    }
+
+    if(   (queue->config.capacity != 0)
+       && (queue->len >= queue->config.capacity)
+       && !overflow_handle(queue, data, &dropped))
+    {
+        goto drop;
+    }
+
 #if 0
     printf("(rt_queue): push(): id = 0x%x, len = %d\n",
             (int) queue_id,
@@ -135,28 +363,53 @@ cleanup:
 
     queue->len++;
 
+    if(queue->len > queue->stats.len_peak)
+    {
+        queue->stats.len_peak = queue->len;
+    }
+
+    if(queue->waiters > 0)
+    {
+        pthread_cond_signal(&queue->not_empty);
+    }
+
     pthread_mutex_unlock(&queue->lock);
+
+    nodes_drop(queue, dropped);
+
+    return;
+
+drop:
+
+    queue->stats.drop_newest++;
+
+    // Started waiting for a key entry with this push?
+    flushed = queue->skipping && !skipping;
+
+    pthread_mutex_unlock(&queue->lock);
+
+    nodes_drop(queue, dropped);
+
+    if(flushed && (queue->config.flush != NULL))
+    {
+        queue->config.flush(queue->config.user_arg);
+    }
+
+    // The pushed entry goes too.
+    node->next = NULL;
+
+    nodes_drop(queue, node);
 }
 
 
-// --------------------------------------------------------
-// rt_queue_pull
-//      Pull a data payload.
-//
-void * sx_queue_pull(
-    SX_QUEUE    queue_id
+// Unlink the head entry. Lock held, NULL if empty.
+static void * head_pull(
+    sQUEUE *queue
     )
 {
-    sQUEUE         *queue;
     unsigned char  *data;
 
 
-    // Get queue.
-    queue = queue_id;
-
-    // Lock.
-    pthread_mutex_lock(&queue->lock);
-
 #if 0
     printf("(rt_queue): pull(): id = 0x%x, len = %d\n",
             (int) queue,
@@ -169,9 +422,7 @@ void * sx_queue_pull(
         assert(queue->tail == NULL);
 
         // List is empty.
-        data = NULL;
-
-        goto cleanup;
+        return NULL;
     }
 
     if(queue->head == queue->tail)
@@ -208,17 +459,162 @@ void * sx_queue_pull(
 
 cleanup:
 
-    if(data != NULL)
+    queue->len--;
+
+    return data;
+}
+
+
+// Room was made, wake blocked producers. Lock held.
+static void room_signal(
+    sQUEUE         *queue,
+    unsigned int    count
+    )
+{
+    if((queue->config.capacity == 0) || (count == 0))
     {
-        queue->len--;
+        return;
     }
 
+    if(count == 1)
+    {
+        pthread_cond_signal(&queue->not_full);
+    }
+    else
+    {
+        pthread_cond_broadcast(&queue->not_full);
+    }
+}
+
+
+// --------------------------------------------------------
+// rt_queue_pull
+//      Pull a data payload.
+//
+void * sx_queue_pull(
+    SX_QUEUE    queue_id
+    )
+{
+    sQUEUE         *queue;
+    unsigned char  *data;
+
+
+    // Get queue.
+    queue = queue_id;
+
+    // Lock.
+    pthread_mutex_lock(&queue->lock);
+
+    data = head_pull(queue);
+
+    room_signal(queue, data != NULL);
+
     pthread_mutex_unlock(&queue->lock);
 
     return data;
 }
 
 
+// --------------------------------------------------------
+// sx_queue_pull_wait
+//      Pull a data payload, waiting up to timeout_us for one
+//      to arrive (SX_QUEUE_WAIT_FOREVER for no limit, 0 for
+//      none). Returns NULL on timeout.
+//
+void * sx_queue_pull_wait(
+    SX_QUEUE        queue_id,
+    unsigned int    timeout_us
+    )
+{
+    sQUEUE             *queue;
+    unsigned char      *data;
+    struct timespec     deadline;
+    unsigned long long  nsec;
+    int                 rv;
+
+
+    // Get queue.
+    queue = queue_id;
+
+    if((timeout_us != 0) && (timeout_us != SX_QUEUE_WAIT_FOREVER))
+    {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+        nsec = deadline.tv_nsec + (unsigned long long) timeout_us * 1000;
+
+        deadline.tv_sec    += nsec / 1000000000;
+        deadline.tv_nsec    = nsec % 1000000000;
+    }
+
+    // Lock.
+    pthread_mutex_lock(&queue->lock);
+
+    rv = 0;
+    while((queue->head == NULL) && (timeout_us != 0) && (rv == 0))
+    {
+        queue->waiters++;
+
+        if(timeout_us == SX_QUEUE_WAIT_FOREVER)
+        {
+            pthread_cond_wait(&queue->not_empty, &queue->lock);
+        }
+        else
+        {
+            rv = pthread_cond_timedwait(&queue->not_empty, &queue->lock, &deadline);
+        }
+
+        queue->waiters--;
+    }
+
+    data = head_pull(queue);
+
+    room_signal(queue, data != NULL);
+
+    pthread_mutex_unlock(&queue->lock);
+
+    return data;
+}
+
+
+// --------------------------------------------------------
+// sx_queue_pull_many
+//      Pull up to count_max data payloads in one go.
+//
+//      Returns the number pulled, 0 when empty.
+//
+unsigned int sx_queue_pull_many(
+    SX_QUEUE        queue_id,
+    void          **data,
+    unsigned int    count_max
+    )
+{
+    sQUEUE         *queue;
+    unsigned int    count;
+
+
+    // Get queue.
+    queue = queue_id;
+
+    // Lock.
+    pthread_mutex_lock(&queue->lock);
+
+    for(count = 0; count < count_max; count++)
+    {
+        data[count] = head_pull(queue);
+        if(data[count] == NULL)
+        {
+            break;
+        }
+    }
+
+    room_signal(queue, count);
+
+    pthread_mutex_unlock(&queue->lock);
+
+    return count;
+}
+
+
 unsigned int sx_queue_len_get(
     SX_QUEUE    queue_id
     )
@@ -238,3 +634,60 @@ unsigned int sx_queue_len_get(
 
     return len;
 }
+
+
+void sx_queue_stats_get(
+    SX_QUEUE            queue_id,
+    sSX_QUEUE_STATS    *stats
+    )
+{
+    sQUEUE *queue;
+
+
+    // Get queue.
+    queue = queue_id;
+
+    pthread_mutex_lock(&queue->lock);
+
+    *stats      = queue->stats;
+    stats->len  = queue->len;
+
+    pthread_mutex_unlock(&queue->lock);
+}
+
+
+void sx_queue_stats_log(
+    SX_QUEUE            queue_id,
+    const char         *name
+    )
+{
+    sQUEUE             *queue;
+    sSX_QUEUE_STATS     stats;
+
+
+    // Get queue.
+    queue = queue_id;
+
+    sx_queue_stats_get(queue_id, &stats);
+
+    logger_log("(sx_queue): %s [capacity = %d, policy = %s]: len = %d, peak = %d, blocked = %d, dropped newest = %d, oldest = %d, flushed = %d",
+               name,
+               queue->config.capacity,
+               sx_queue_policy_name_get(queue->config.policy),
+               stats.len,
+               stats.len_peak,
+               stats.block_count,
+               stats.drop_newest,
+               stats.drop_oldest,
+               stats.flush_count);
+}
+
+
+const char * sx_queue_policy_name_get(
+    eSX_QUEUE_POLICY    policy
+    )
+{
+    assert(policy < (sizeof(f_policy_names) / sizeof(f_policy_names[0])));
+
+    return f_policy_names[policy];
+}
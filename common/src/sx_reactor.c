@@ -0,0 +1,370 @@
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <assert.h>
+
+#include "logger.h"
+#include "sx_mailbox.h"
+#include "sx_timer.h"
+#include "sx_reactor.h"
+
+// Events taken per epoll_wait().
+#define REACTOR_EVENTS_MAX      16
+
+
+typedef enum
+{
+    REACTOR_FD_FREE,            ///< Unused.
+    REACTOR_FD_ACTIVE,          ///< Registered.
+    REACTOR_FD_REMOVED,         ///< Removed, reusable once the current round of events is done.
+
+} eREACTOR_FD_STATE;
+
+
+typedef struct
+{
+    eREACTOR_FD_STATE   state;      ///< Slot state.
+    int                 fd;         ///< Polled for input.
+    SX_MAILBOX          mailbox;    ///< Mailbox behind fd, NULL for a plain fd.
+    fSX_REACTOR_CBACK   cback;      ///< Readable callback.
+    void               *arg;        ///< Callback argument.
+
+} sREACTOR_FD;
+
+
+typedef struct
+{
+    fSX_REACTOR_CBACK   cback;      ///< Flush callback.
+    void               *arg;        ///< Callback argument.
+
+} sREACTOR_FLUSH;
+
+
+typedef struct
+{
+    unsigned char       enabled;            ///< sx_reactor_init() was called.
+    int                 epoll_fd;           ///< Waits on everything.
+    SX_TIMER_WHEEL      wheel;              ///< Timers run by the loop.
+
+    sREACTOR_FD         fds[SX_REACTOR_FDS_MAX];        ///< Registrations.
+    sREACTOR_FLUSH      flushes[SX_REACTOR_FLUSHES_MAX];///< Run before sleeping.
+    unsigned int        flush_count;        ///< Flush callbacks registered.
+
+    unsigned int        round_count;        ///< epoll_wait() returns.
+    unsigned int        event_count;        ///< Events handled.
+
+} sREACTOR_CBLK;
+
+
+// Control block.
+static sREACTOR_CBLK f_cblk;
+
+
+// Registration slot for fd, or a free one.
+static sREACTOR_FD * fd_slot_get(
+    int             fd,
+    unsigned char   allocate
+    )
+{
+    unsigned int    i;
+
+
+    for(i = 0; i < SX_REACTOR_FDS_MAX; i++)
+    {
+        if(allocate)
+        {
+            if(f_cblk.fds[i].state == REACTOR_FD_FREE)
+            {
+                return &f_cblk.fds[i];
+            }
+        }
+        else if((f_cblk.fds[i].state == REACTOR_FD_ACTIVE) && (f_cblk.fds[i].fd == fd))
+        {
+            return &f_cblk.fds[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+static void fd_register(
+    int                 fd,
+    SX_MAILBOX          mailbox,
+    fSX_REACTOR_CBACK   cback,
+    void               *arg
+    )
+{
+    sREACTOR_FD        *slot;
+    struct epoll_event  event;
+    int                 rv;
+
+
+    assert(f_cblk.enabled);
+
+    slot = fd_slot_get(fd, 1);
+    assert(slot != NULL);
+
+    slot->state     = REACTOR_FD_ACTIVE;
+    slot->fd        = fd;
+    slot->mailbox   = mailbox;
+    slot->cback     = cback;
+    slot->arg       = arg;
+
+    memset(&event, 0, sizeof(event));
+
+    event.events    = EPOLLIN;
+    event.data.ptr  = slot;
+
+    rv = epoll_ctl(f_cblk.epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    assert(rv == 0);
+}
+
+
+static void flushes_run(
+    void
+    )
+{
+    unsigned int    i;
+
+
+    for(i = 0; i < f_cblk.flush_count; i++)
+    {
+        f_cblk.flushes[i].cback(f_cblk.flushes[i].arg);
+    }
+}
+
+
+// Wheel timerfd fired.
+static void wheel_cback(
+    void   *arg
+    )
+{
+    sx_timer_wheel_run(f_cblk.wheel);
+}
+
+
+// --------------------------------------------------------
+// sx_reactor_init
+//      Select the single-threaded mode. Must be called before
+//      any manager is initialized.
+//
+void sx_reactor_init(
+    void
+    )
+{
+    f_cblk.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    assert(f_cblk.epoll_fd >= 0);
+
+    f_cblk.wheel = sx_timer_wheel_create();
+
+    f_cblk.enabled = 1;
+
+    fd_register(sx_timer_wheel_fd_get(f_cblk.wheel), NULL, wheel_cback, NULL);
+}
+
+
+// --------------------------------------------------------
+// sx_reactor_enabled
+//      Do managers run from the reactor instead of their own
+//      threads?
+//
+unsigned char sx_reactor_enabled(
+    void
+    )
+{
+    return f_cblk.enabled;
+}
+
+
+// --------------------------------------------------------
+// sx_reactor_fd_add
+//      Call cback whenever fd is readable. The handler must not
+//      block, it holds up everything else.
+//
+void sx_reactor_fd_add(
+    int                 fd,
+    fSX_REACTOR_CBACK   cback,
+    void               *arg
+    )
+{
+    fd_register(fd, NULL, cback, arg);
+}
+
+
+// --------------------------------------------------------
+// sx_reactor_fd_remove
+//      Stop polling fd, from any handler. Closing it is up to the
+//      caller.
+//
+void sx_reactor_fd_remove(
+    int     fd
+    )
+{
+    sREACTOR_FD    *slot;
+    int             rv;
+
+
+    slot = fd_slot_get(fd, 0);
+    assert(slot != NULL);
+
+    rv = epoll_ctl(f_cblk.epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    assert(rv == 0);
+
+    // Events already taken for it are skipped.
+    slot->state = REACTOR_FD_REMOVED;
+}
+
+
+// --------------------------------------------------------
+// sx_reactor_mailbox_add
+//      Call cback when messages may be waiting in the mailbox.
+//      cback takes them with sx_mailbox_poll() until it returns
+//      0, which arms the next wakeup.
+//
+void sx_reactor_mailbox_add(
+    SX_MAILBOX          mailbox,
+    fSX_REACTOR_CBACK   cback,
+    void               *arg
+    )
+{
+    fd_register(sx_mailbox_fd_get(mailbox), mailbox, cback, arg);
+}
+
+
+// --------------------------------------------------------
+// sx_reactor_flush_add
+//      Call cback after every round of events, before the loop
+//      sleeps again. For work handlers batch up between them.
+//
+void sx_reactor_flush_add(
+    fSX_REACTOR_CBACK   cback,
+    void               *arg
+    )
+{
+    assert(f_cblk.enabled);
+    assert(f_cblk.flush_count < SX_REACTOR_FLUSHES_MAX);
+
+    f_cblk.flushes[f_cblk.flush_count].cback    = cback;
+    f_cblk.flushes[f_cblk.flush_count].arg      = arg;
+
+    f_cblk.flush_count++;
+}
+
+
+// --------------------------------------------------------
+// sx_reactor_wheel_get
+//      Timer wheel run by the loop. Arm and cancel its timers from
+//      handlers only.
+//
+SX_TIMER_WHEEL sx_reactor_wheel_get(
+    void
+    )
+{
+    assert(f_cblk.enabled);
+
+    return f_cblk.wheel;
+}
+
+
+// --------------------------------------------------------
+// sx_reactor_run
+//      Run the event loop on the calling thread, never returns.
+//
+void sx_reactor_run(
+    void
+    )
+{
+    struct epoll_event  events[REACTOR_EVENTS_MAX];
+    sREACTOR_FD        *slot;
+    unsigned long long  count;
+    unsigned int        fd_count;
+    unsigned int        i;
+    int                 event_num;
+    int                 rv;
+
+
+    assert(f_cblk.enabled);
+
+    fd_count = 0;
+
+    // Messages sent before the loop started arrived without a wakeup.
+    for(i = 0; i < SX_REACTOR_FDS_MAX; i++)
+    {
+        slot = &f_cblk.fds[i];
+
+        if(slot->state != REACTOR_FD_ACTIVE)
+        {
+            continue;
+        }
+
+        fd_count++;
+
+        if(slot->mailbox != NULL)
+        {
+            slot->cback(slot->arg);
+        }
+    }
+
+    flushes_run();
+
+    logger_log("(sx_reactor_run): Running. [fds = %d]",
+               fd_count);
+
+    while(1)
+    {
+        event_num = epoll_wait(f_cblk.epoll_fd, events, REACTOR_EVENTS_MAX, -1);
+        if(event_num < 0)
+        {
+            // Interrupted by a signal.
+            continue;
+        }
+
+        f_cblk.round_count++;
+
+        for(i = 0; i < (unsigned int) event_num; i++)
+        {
+            slot = events[i].data.ptr;
+
+            if(slot->state != REACTOR_FD_ACTIVE)
+            {
+                continue;
+            }
+
+            if(slot->mailbox != NULL)
+            {
+                // Clear the wakeup before draining, a send after the
+                // drain sets it again.
+                rv = read(slot->fd, &count, sizeof(count));
+                assert(rv == sizeof(count));
+            }
+
+            f_cblk.event_count++;
+
+            slot->cback(slot->arg);
+        }
+
+        flushes_run();
+
+        // Removed slots are free once nothing of this round refers to them.
+        for(i = 0; i < SX_REACTOR_FDS_MAX; i++)
+        {
+            if(f_cblk.fds[i].state == REACTOR_FD_REMOVED)
+            {
+                f_cblk.fds[i].state = REACTOR_FD_FREE;
+            }
+        }
+    }
+}
+
+
+void sx_reactor_stats_log(
+    void
+    )
+{
+    logger_log("(sx_reactor): rounds = %d, events = %d",
+               f_cblk.round_count,
+               f_cblk.event_count);
+
+    sx_timer_wheel_stats_log(f_cblk.wheel, "reactor");
+}
@@ -0,0 +1,453 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "logger.h"
+#include "sx_queue.h"
+#include "sx_ring.h"
+
+#define RING_BENCH_SIZE     1024
+#define RING_BENCH_BATCH    32
+
+
+// Indices run free and wrap, slots are taken modulo the power of two
+// size. Each side caches the other's index and only reloads it when the
+// ring looks full (or empty), so the shared lines bounce rarely.
+typedef struct
+{
+    unsigned int    head __attribute__((aligned(SX_RING_CACHE_LINE)));  ///< Next slot to write, producer owned.
+    unsigned int    tail_cache;                                         ///< Producer's view of tail.
+
+    unsigned int    tail __attribute__((aligned(SX_RING_CACHE_LINE)));  ///< Next slot to read, consumer owned.
+    unsigned int    head_cache;                                         ///< Consumer's view of head.
+
+    unsigned int    mask __attribute__((aligned(SX_RING_CACHE_LINE)));  ///< Size - 1.
+    void          **slots;                                              ///< Entries.
+
+} sRING;
+
+
+// --------------------------------------------------------
+// sx_ring_create
+//      Create a ring holding at least size entries, rounded up
+//      to a power of two.
+//
+SX_RING sx_ring_create(
+    unsigned int    size
+    )
+{
+    sRING          *ring;
+    unsigned int    ring_size;
+    int             rv;
+
+
+    assert((size > 0) && (size <= 0x80000000));
+
+    ring_size = 2;
+    while(ring_size < size)
+    {
+        ring_size <<= 1;
+    }
+
+    rv = posix_memalign((void **) &ring, SX_RING_CACHE_LINE, sizeof(sRING));
+    assert(rv == 0);
+
+    ring->head          = 0;
+    ring->tail_cache    = 0;
+    ring->tail          = 0;
+    ring->head_cache    = 0;
+    ring->mask          = ring_size - 1;
+    ring->slots         = malloc(ring_size * sizeof(void *));
+
+    return ring;
+}
+
+
+// --------------------------------------------------------
+// sx_ring_destroy
+//      Destroy a ring. Entries are the caller's, drain it first.
+//
+void sx_ring_destroy(
+    SX_RING         ring_id
+    )
+{
+    sRING  *ring;
+
+
+    ring = ring_id;
+
+    assert(ring->head == ring->tail);
+
+    free(ring->slots);
+    free(ring);
+}
+
+
+// --------------------------------------------------------
+// sx_ring_push_many
+//      Producer side. Queue up to count entries, as many as
+//      there is room for, and publish them at once.
+//
+//      Returns the number queued.
+//
+unsigned int sx_ring_push_many(
+    SX_RING         ring_id,
+    void          **data,
+    unsigned int    count
+    )
+{
+    sRING          *ring;
+    unsigned int    head;
+    unsigned int    room;
+    unsigned int    i;
+
+
+    ring = ring_id;
+
+    head = ring->head;
+
+    room = (ring->mask + 1) - (head - ring->tail_cache);
+    if(room < count)
+    {
+        ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+        room = (ring->mask + 1) - (head - ring->tail_cache);
+    }
+
+    if(count > room)
+    {
+        count = room;
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        assert(data[i] != NULL);
+
+        ring->slots[(head + i) & ring->mask] = data[i];
+    }
+
+    // Slots are written before the consumer can see them.
+    __atomic_store_n(&ring->head, head + count, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+
+// --------------------------------------------------------
+// sx_ring_pull_many
+//      Consumer side. Take up to count_max entries in one go.
+//
+//      Returns the number taken, 0 when empty.
+//
+unsigned int sx_ring_pull_many(
+    SX_RING         ring_id,
+    void          **data,
+    unsigned int    count_max
+    )
+{
+    sRING          *ring;
+    unsigned int    tail;
+    unsigned int    count;
+    unsigned int    i;
+
+
+    ring = ring_id;
+
+    tail = ring->tail;
+
+    count = ring->head_cache - tail;
+    if(count < count_max)
+    {
+        ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+        count = ring->head_cache - tail;
+    }
+
+    if(count > count_max)
+    {
+        count = count_max;
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        data[i] = ring->slots[(tail + i) & ring->mask];
+    }
+
+    // Slots are read before the producer can reuse them.
+    __atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+
+// --------------------------------------------------------
+// sx_ring_push
+//      Producer side. Returns 0 if the ring is full.
+//
+unsigned char sx_ring_push(
+    SX_RING         ring,
+    void           *data
+    )
+{
+    return sx_ring_push_many(ring, &data, 1);
+}
+
+
+// --------------------------------------------------------
+// sx_ring_pull
+//      Consumer side. Returns NULL if the ring is empty.
+//
+void * sx_ring_pull(
+    SX_RING         ring
+    )
+{
+    void   *data;
+
+
+    if(sx_ring_pull_many(ring, &data, 1) == 0)
+    {
+        return NULL;
+    }
+
+    return data;
+}
+
+
+// Entries queued, a snapshot from any thread.
+unsigned int sx_ring_len_get(
+    SX_RING         ring_id
+    )
+{
+    sRING  *ring;
+
+
+    ring = ring_id;
+
+    return   __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)
+           - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+
+unsigned int sx_ring_size_get(
+    SX_RING         ring_id
+    )
+{
+    return ((sRING *) ring_id)->mask + 1;
+}
+
+
+typedef enum
+{
+    RING_BENCH_QUEUE,
+    RING_BENCH_QUEUE_WAIT,
+    RING_BENCH_RING,
+    RING_BENCH_RING_BATCH,
+
+} eRING_BENCH;
+
+
+typedef struct
+{
+    eRING_BENCH     kind;           ///< Container under test.
+    void           *container;      ///< SX_QUEUE or SX_RING.
+    unsigned int    items;          ///< Entries to pass through.
+    unsigned int    full_count;     ///< Producer found the ring full.
+
+} sRING_BENCH;
+
+
+// Push 1 .. items, yielding while the ring is full.
+static void bench_producer(
+    void   *arg
+    )
+{
+    sRING_BENCH    *bench;
+    void           *batch[RING_BENCH_BATCH];
+    unsigned int    next;
+    unsigned int    count;
+    unsigned int    i;
+
+
+    bench = arg;
+
+    next = 1;
+    while(next <= bench->items)
+    {
+        count = 1;
+        if(bench->kind == RING_BENCH_RING_BATCH)
+        {
+            count = bench->items - next + 1;
+            if(count > RING_BENCH_BATCH)
+            {
+                count = RING_BENCH_BATCH;
+            }
+        }
+
+        for(i = 0; i < count; i++)
+        {
+            batch[i] = (void *) (uintptr_t) (next + i);
+        }
+
+        switch(bench->kind)
+        {
+            case RING_BENCH_QUEUE:
+            case RING_BENCH_QUEUE_WAIT:
+            {
+                sx_queue_push(bench->container, batch[0]);
+                break;
+            }
+            case RING_BENCH_RING:
+            {
+                count = sx_ring_push(bench->container, batch[0]);
+                break;
+            }
+            case RING_BENCH_RING_BATCH:
+            {
+                count = sx_ring_push_many(bench->container, batch, count);
+                break;
+            }
+        }
+
+        if(count == 0)
+        {
+            bench->full_count++;
+
+            sched_yield();
+        }
+
+        next += count;
+    }
+}
+
+
+// Pull everything back in order on this thread, against a producer
+// thread. Returns the seconds it took.
+static double bench_run(
+    sRING_BENCH    *bench
+    )
+{
+    pthread_t       producer;
+    struct timespec start;
+    struct timespec now;
+    void           *batch[RING_BENCH_BATCH];
+    unsigned int    expected;
+    unsigned int    count;
+    unsigned int    i;
+
+
+    bench->full_count = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_create(&producer, NULL, (void *) &bench_producer, bench);
+
+    expected = 1;
+    while(expected <= bench->items)
+    {
+        switch(bench->kind)
+        {
+            case RING_BENCH_QUEUE:
+            {
+                batch[0]    = sx_queue_pull(bench->container);
+                count       = (batch[0] != NULL);
+                break;
+            }
+            case RING_BENCH_QUEUE_WAIT:
+            {
+                // Sleep until something arrives, then take the burst.
+                batch[0]    = sx_queue_pull_wait(bench->container, SX_QUEUE_WAIT_FOREVER);
+                count       = 1 + sx_queue_pull_many(bench->container, &batch[1], RING_BENCH_BATCH - 1);
+                break;
+            }
+            case RING_BENCH_RING:
+            {
+                batch[0]    = sx_ring_pull(bench->container);
+                count       = (batch[0] != NULL);
+                break;
+            }
+            default:
+            {
+                count = sx_ring_pull_many(bench->container, batch, RING_BENCH_BATCH);
+                break;
+            }
+        }
+
+        if(count == 0)
+        {
+            sched_yield();
+        }
+
+        for(i = 0; i < count; i++)
+        {
+            assert(batch[i] == (void *) (uintptr_t) expected);
+
+            expected++;
+        }
+    }
+
+    pthread_join(producer, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+
+// --------------------------------------------------------
+// sx_ring_benchmark
+//      Pass items pointers from a producer thread to a consumer
+//      thread through sx_queue (polled, then blocking and batched),
+//      through a ring one at a time and through a ring in batches,
+//      and log the throughput of each.
+//
+void sx_ring_benchmark(
+    unsigned int    items
+    )
+{
+    sRING_BENCH     bench;
+    double          queue_sec;
+    double          wait_sec;
+    double          ring_sec;
+    double          batch_sec;
+    unsigned int    ring_full;
+    unsigned int    batch_full;
+
+
+    assert(items > 0);
+
+    bench.items = items;
+
+    bench.kind      = RING_BENCH_QUEUE;
+    bench.container = sx_queue_create();
+    queue_sec       = bench_run(&bench);
+
+    bench.kind      = RING_BENCH_QUEUE_WAIT;
+    wait_sec        = bench_run(&bench);
+    sx_queue_destroy(bench.container);
+
+    bench.kind      = RING_BENCH_RING;
+    bench.container = sx_ring_create(RING_BENCH_SIZE);
+    ring_sec        = bench_run(&bench);
+    ring_full       = bench.full_count;
+
+    bench.kind      = RING_BENCH_RING_BATCH;
+    batch_sec       = bench_run(&bench);
+    batch_full      = bench.full_count;
+    sx_ring_destroy(bench.container);
+
+    logger_log("(sx_ring): %d items, ring size = %d, batch = %d",
+               items,
+               RING_BENCH_SIZE,
+               RING_BENCH_BATCH);
+
+    logger_log("(sx_ring): sx_queue = %.1f Mops/s, sx_queue wait/batch = %.1f Mops/s, ring = %.1f Mops/s (full %d), ring batch = %.1f Mops/s (full %d)",
+               items / queue_sec / 1e6,
+               items / wait_sec / 1e6,
+               items / ring_sec / 1e6,
+               ring_full,
+               items / batch_sec / 1e6,
+               batch_full);
+}
@@ -0,0 +1,237 @@
+#include <string.h>
+#include <assert.h>
+
+#include "sx_slab.h"
+#include "sx_seg.h"
+
+
+// --------------------------------------------------------
+// sx_seg_init
+//      Make seg an empty, unchained segment over data.
+//
+void sx_seg_init(
+    sSX_SEG        *seg,
+    unsigned char  *data,
+    unsigned int    size
+    )
+{
+    seg->next   = NULL;
+    seg->data   = data;
+    seg->len    = 0;
+    seg->size   = size;
+}
+
+
+// --------------------------------------------------------
+// sx_seg_append
+//      Copy len bytes to the end of the chain, chaining on
+//      SX_SEG_SIZE segments as the tail fills up.
+//
+void sx_seg_append(
+    sSX_SEG                *head,
+    const unsigned char    *data,
+    unsigned int            len
+    )
+{
+    sSX_SEG        *tail;
+    sSX_SEG        *seg;
+    unsigned int    bytes_to_copy;
+
+
+    tail = head;
+    while(tail->next != NULL)
+    {
+        tail = tail->next;
+    }
+
+    while(len > 0)
+    {
+        if(tail->len == tail->size)
+        {
+            // Segment header and payload in one slab block.
+            seg = sx_slab_alloc(sizeof(sSX_SEG) + SX_SEG_SIZE);
+
+            sx_seg_init(seg, (unsigned char *) (seg + 1), SX_SEG_SIZE);
+
+            tail->next  = seg;
+            tail        = seg;
+        }
+
+        bytes_to_copy = tail->size - tail->len;
+        if(bytes_to_copy > len)
+        {
+            bytes_to_copy = len;
+        }
+
+        memcpy(&tail->data[tail->len], data, bytes_to_copy);
+
+        tail->len  += bytes_to_copy;
+        data       += bytes_to_copy;
+        len        -= bytes_to_copy;
+    }
+}
+
+
+// --------------------------------------------------------
+// sx_seg_trim_zeros
+//      Drop zero bytes from the end of the chain, freeing
+//      chained segments they empty. Returns the bytes dropped.
+//
+unsigned int sx_seg_trim_zeros(
+    sSX_SEG    *head
+    )
+{
+    sSX_SEG        *prev;
+    sSX_SEG        *tail;
+    unsigned int    count;
+
+
+    count = 0;
+
+    while(1)
+    {
+        prev = NULL;
+        for(tail = head; tail->next != NULL; tail = tail->next)
+        {
+            prev = tail;
+        }
+
+        while((tail->len > 0) && (tail->data[tail->len - 1] == 0x00))
+        {
+            tail->len--;
+            count++;
+        }
+
+        if((tail->len > 0) || (prev == NULL))
+        {
+            return count;
+        }
+
+        // Emptied a chained segment, keep going in the one before.
+        sx_slab_free(tail);
+
+        prev->next = NULL;
+    }
+}
+
+
+// --------------------------------------------------------
+// sx_seg_chain_free
+//      Free seg and every segment after it. Only for segments
+//      chained on by sx_seg_append().
+//
+void sx_seg_chain_free(
+    sSX_SEG    *seg
+    )
+{
+    sSX_SEG *next;
+
+
+    while(seg != NULL)
+    {
+        next = seg->next;
+
+        sx_slab_free(seg);
+
+        seg = next;
+    }
+}
+
+
+void sx_seg_cursor_init(
+    sSX_SEG_CURSOR     *cursor,
+    const sSX_SEG      *head
+    )
+{
+    cursor->seg     = head;
+    cursor->offset  = 0;
+}
+
+
+// --------------------------------------------------------
+// sx_seg_read
+//      Copy up to len bytes from the cursor across segment
+//      boundaries and advance it. Returns the bytes copied.
+//
+unsigned int sx_seg_read(
+    sSX_SEG_CURSOR     *cursor,
+    unsigned char      *dst,
+    unsigned int        len
+    )
+{
+    unsigned int    count;
+    unsigned int    bytes_to_copy;
+
+
+    count = 0;
+
+    while((len > 0) && (cursor->seg != NULL))
+    {
+        bytes_to_copy = cursor->seg->len - cursor->offset;
+        if(bytes_to_copy > len)
+        {
+            bytes_to_copy = len;
+        }
+
+        memcpy(dst, &cursor->seg->data[cursor->offset], bytes_to_copy);
+
+        cursor->offset += bytes_to_copy;
+        dst            += bytes_to_copy;
+        len            -= bytes_to_copy;
+        count          += bytes_to_copy;
+
+        if(cursor->offset == cursor->seg->len)
+        {
+            cursor->seg     = cursor->seg->next;
+            cursor->offset  = 0;
+        }
+    }
+
+    return count;
+}
+
+
+// --------------------------------------------------------
+// sx_seg_map
+//      Like sx_seg_read(), but describe the next len bytes with
+//      up to iov_max iovecs into the segments instead of copying
+//      them. Returns the iovecs used, the cursor stops early if
+//      they run out.
+//
+unsigned int sx_seg_map(
+    sSX_SEG_CURSOR     *cursor,
+    struct iovec       *iov,
+    unsigned int        iov_max,
+    unsigned int        len
+    )
+{
+    unsigned int    count;
+    unsigned int    bytes_to_map;
+
+
+    count = 0;
+
+    while((len > 0) && (cursor->seg != NULL) && (count < iov_max))
+    {
+        bytes_to_map = cursor->seg->len - cursor->offset;
+        if(bytes_to_map > len)
+        {
+            bytes_to_map = len;
+        }
+
+        iov[count].iov_base = &cursor->seg->data[cursor->offset];
+        iov[count].iov_len  = bytes_to_map;
+
+        cursor->offset += bytes_to_map;
+        len            -= bytes_to_map;
+        count++;
+
+        if(cursor->offset == cursor->seg->len)
+        {
+            cursor->seg     = cursor->seg->next;
+            cursor->offset  = 0;
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,295 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "logger.h"
+#include "sx_slab.h"
+
+// Class index for blocks too large for any class.
+#define SLAB_CLASS_OVERSIZE     SX_SLAB_CLASS_NUM
+
+
+// Block header, sits in front of the payload.
+typedef struct sSLAB_HDR
+{
+    union
+    {
+        struct sSLAB_HDR   *next;           ///< Freelist link.
+        unsigned long long  align;          ///< Keeps the payload 8 byte aligned.
+
+    } link;
+
+    unsigned int            size_class;     ///< Class index.
+    unsigned int            capacity;       ///< Payload bytes available.
+
+} sSLAB_HDR;
+
+
+typedef struct
+{
+    pthread_mutex_t         lock;           ///< Class lock.
+    sSLAB_HDR              *free_list;      ///< Cached blocks.
+    sSX_SLAB_CLASS_STATS    stats;          ///< Counters.
+
+} sSLAB_CLASS;
+
+
+// Slab control block.
+static sSLAB_CLASS      f_classes[SX_SLAB_CLASS_NUM];
+static pthread_once_t   f_once = PTHREAD_ONCE_INIT;
+
+
+static void slab_init(
+    void
+    )
+{
+    unsigned int i;
+
+
+    for(i = 0; i < SX_SLAB_CLASS_NUM; i++)
+    {
+        pthread_mutex_init(&f_classes[i].lock, NULL);
+
+        f_classes[i].free_list          = NULL;
+        f_classes[i].stats.block_size   = 1 << (SX_SLAB_CLASS_MIN_SHIFT + i);
+    }
+}
+
+
+// Smallest class whose block holds size payload bytes.
+static unsigned int size_class_get(
+    unsigned int    size
+    )
+{
+    unsigned int    size_class;
+    unsigned int    block_size;
+
+
+    block_size = size + sizeof(sSLAB_HDR);
+
+    for(size_class = 0; size_class < SX_SLAB_CLASS_NUM; size_class++)
+    {
+        if(block_size <= f_classes[size_class].stats.block_size)
+        {
+            break;
+        }
+    }
+
+    return size_class;
+}
+
+
+static sSLAB_HDR * hdr_get(
+    void   *ptr
+    )
+{
+    return ((sSLAB_HDR *) ptr) - 1;
+}
+
+
+// --------------------------------------------------------
+// sx_slab_alloc
+//      Allocate at least size bytes from the matching size
+//      class.
+//
+void * sx_slab_alloc(
+    unsigned int    size
+    )
+{
+    sSLAB_CLASS    *slab_class;
+    sSLAB_HDR      *hdr;
+    unsigned int    size_class;
+
+
+    pthread_once(&f_once, slab_init);
+
+    size_class = size_class_get(size);
+
+    if(size_class == SLAB_CLASS_OVERSIZE)
+    {
+        hdr = malloc(sizeof(sSLAB_HDR) + size);
+
+        hdr->size_class = SLAB_CLASS_OVERSIZE;
+        hdr->capacity   = size;
+
+        return hdr + 1;
+    }
+
+    slab_class = &f_classes[size_class];
+
+    pthread_mutex_lock(&slab_class->lock);
+
+    hdr = slab_class->free_list;
+    if(hdr != NULL)
+    {
+        slab_class->free_list = hdr->link.next;
+        slab_class->stats.cached--;
+    }
+    else
+    {
+        slab_class->stats.miss_count++;
+    }
+
+    slab_class->stats.alloc_count++;
+    slab_class->stats.in_use++;
+
+    if(slab_class->stats.in_use > slab_class->stats.in_use_peak)
+    {
+        slab_class->stats.in_use_peak = slab_class->stats.in_use;
+    }
+
+    pthread_mutex_unlock(&slab_class->lock);
+
+    if(hdr == NULL)
+    {
+        // Freelist empty, carve a new block.
+        hdr = malloc(slab_class->stats.block_size);
+
+        hdr->size_class = size_class;
+        hdr->capacity   = slab_class->stats.block_size - sizeof(sSLAB_HDR);
+    }
+
+    return hdr + 1;
+}
+
+
+// --------------------------------------------------------
+// sx_slab_free
+//      Return a block to its class freelist.
+//
+void sx_slab_free(
+    void   *ptr
+    )
+{
+    sSLAB_CLASS    *slab_class;
+    sSLAB_HDR      *hdr;
+
+
+    hdr = hdr_get(ptr);
+
+    if(hdr->size_class == SLAB_CLASS_OVERSIZE)
+    {
+        free(hdr);
+
+        return;
+    }
+
+    assert(hdr->size_class < SX_SLAB_CLASS_NUM);
+
+    slab_class = &f_classes[hdr->size_class];
+
+    pthread_mutex_lock(&slab_class->lock);
+
+    assert(slab_class->stats.in_use > 0);
+
+    slab_class->stats.in_use--;
+
+    if(slab_class->stats.cached < SX_SLAB_FREELIST_MAX)
+    {
+        hdr->link.next          = slab_class->free_list;
+        slab_class->free_list   = hdr;
+        slab_class->stats.cached++;
+
+        hdr = NULL;
+    }
+
+    pthread_mutex_unlock(&slab_class->lock);
+
+    if(hdr != NULL)
+    {
+        // Freelist full, give it back to the heap.
+        free(hdr);
+    }
+}
+
+
+// --------------------------------------------------------
+// sx_slab_realloc
+//      Grow a block, keeping its contents. Stays in place if
+//      the current class already holds size bytes.
+//
+void * sx_slab_realloc(
+    void           *ptr,
+    unsigned int    size
+    )
+{
+    void           *new_ptr;
+    unsigned int    capacity;
+
+
+    if(ptr == NULL)
+    {
+        return sx_slab_alloc(size);
+    }
+
+    capacity = hdr_get(ptr)->capacity;
+    if(size <= capacity)
+    {
+        return ptr;
+    }
+
+    new_ptr = sx_slab_alloc(size);
+
+    memcpy(new_ptr, ptr, capacity);
+
+    sx_slab_free(ptr);
+
+    return new_ptr;
+}
+
+
+unsigned int sx_slab_size_get(
+    void   *ptr
+    )
+{
+    return hdr_get(ptr)->capacity;
+}
+
+
+void sx_slab_stats_get(
+    sSX_SLAB_CLASS_STATS    stats[SX_SLAB_CLASS_NUM]
+    )
+{
+    unsigned int i;
+
+
+    pthread_once(&f_once, slab_init);
+
+    for(i = 0; i < SX_SLAB_CLASS_NUM; i++)
+    {
+        pthread_mutex_lock(&f_classes[i].lock);
+
+        stats[i] = f_classes[i].stats;
+
+        pthread_mutex_unlock(&f_classes[i].lock);
+    }
+}
+
+
+void sx_slab_stats_log(
+    void
+    )
+{
+    sSX_SLAB_CLASS_STATS    stats[SX_SLAB_CLASS_NUM];
+    unsigned int            i;
+
+
+    sx_slab_stats_get(stats);
+
+    for(i = 0; i < SX_SLAB_CLASS_NUM; i++)
+    {
+        if(stats[i].alloc_count == 0)
+        {
+            continue;
+        }
+
+        logger_log("(sx_slab): %6d B: alloc = %d, miss = %d, in_use = %d, peak = %d, cached = %d",
+                   stats[i].block_size,
+                   stats[i].alloc_count,
+                   stats[i].miss_count,
+                   stats[i].in_use,
+                   stats[i].in_use_peak,
+                   stats[i].cached);
+    }
+}
@@ -0,0 +1,722 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include <assert.h>
+
+#include "logger.h"
+#include "sx_clock.h"
+#include "sx_timer.h"
+
+#define WHEEL_SLOTS         (1 << SX_TIMER_LEVEL_BITS)
+#define WHEEL_MASK          (WHEEL_SLOTS - 1)
+
+// Ticks a level's slot spans.
+#define LEVEL_SPAN(level)   (1ULL << (SX_TIMER_LEVEL_BITS * (level)))
+
+// Furthest expiry the wheel holds exactly (ticks from now).
+#define WHEEL_RANGE         LEVEL_SPAN(SX_TIMER_LEVELS)
+
+// sSX_TIMER slot of a timer taken off the wheel to expire.
+#define SLOT_EXPIRING       0xFFFFFFFF
+
+#define TICK_NONE           0xFFFFFFFFFFFFFFFFULL
+
+
+// Slot lists are circular, headed by a sentinel. A set bit in occupied
+// marks a non-empty slot, so the next event is found without scanning.
+typedef struct
+{
+    sSX_TIMER           slots[SX_TIMER_LEVELS][WHEEL_SLOTS];    ///< Sentinels.
+    unsigned long long  occupied[SX_TIMER_LEVELS];  ///< Non-empty slots.
+
+    unsigned long long  base_us;    ///< Tick 0.
+    unsigned long long  now;        ///< Ticks processed.
+
+    int                 timer_fd;   ///< Fires at the next event, -1 until asked for.
+    unsigned long long  fd_tick;    ///< Tick timer_fd is set for, TICK_NONE if disarmed.
+
+    sSX_TIMER_STATS     stats;      ///< Counters.
+
+} sTIMER_WHEEL;
+
+
+static void list_init(
+    sSX_TIMER  *head
+    )
+{
+    head->next = head;
+    head->prev = head;
+}
+
+
+// Rotate right, bit start first.
+static unsigned long long bits_rotate(
+    unsigned long long  bits,
+    unsigned int        start
+    )
+{
+    start &= WHEEL_MASK;
+
+    if(start == 0)
+    {
+        return bits;
+    }
+
+    return (bits >> start) | (bits << (WHEEL_SLOTS - start));
+}
+
+
+// --------------------------------------------------------
+// next_tick_get
+//      Earliest tick with work: a level 0 slot to expire, or a
+//      higher level slot to cascade. A slot of level k is
+//      cascaded at the first tick past now that is a multiple of
+//      its span with the slot's index.
+//
+static unsigned long long next_tick_get(
+    sTIMER_WHEEL   *wheel
+    )
+{
+    unsigned long long  next;
+    unsigned long long  first;
+    unsigned long long  tick;
+    unsigned int        level;
+    unsigned int        shift;
+
+
+    next = TICK_NONE;
+
+    for(level = 0; level < SX_TIMER_LEVELS; level++)
+    {
+        if(wheel->occupied[level] == 0)
+        {
+            continue;
+        }
+
+        shift = SX_TIMER_LEVEL_BITS * level;
+
+        // First slot index past now at this level.
+        first = (wheel->now >> shift) + 1;
+
+        tick = (first + __builtin_ctzll(bits_rotate(wheel->occupied[level], first))) << shift;
+
+        if(tick < next)
+        {
+            next = tick;
+        }
+    }
+
+    return next;
+}
+
+
+// Link a timer in the slot its expiry falls in, relative to now.
+static void timer_place(
+    sTIMER_WHEEL   *wheel,
+    sSX_TIMER      *timer
+    )
+{
+    sSX_TIMER          *head;
+    unsigned long long  delta;
+    unsigned long long  tick;
+    unsigned int        level;
+    unsigned int        slot;
+
+
+    assert(timer->expires > wheel->now);
+
+    delta   = timer->expires - wheel->now;
+    tick    = timer->expires;
+
+    level = 0;
+    while((level < SX_TIMER_LEVELS - 1) && (delta >= LEVEL_SPAN(level + 1)))
+    {
+        level++;
+    }
+
+    if(delta >= WHEEL_RANGE)
+    {
+        // Parked at the far end, placed again when it cascades.
+        tick = wheel->now + WHEEL_RANGE - 1;
+    }
+
+    slot = (tick >> (SX_TIMER_LEVEL_BITS * level)) & WHEEL_MASK;
+    head = &wheel->slots[level][slot];
+
+    timer->next         = head;
+    timer->prev         = head->prev;
+    head->prev->next    = timer;
+    head->prev          = timer;
+
+    timer->slot = level * WHEEL_SLOTS + slot;
+
+    wheel->occupied[level] |= 1ULL << slot;
+}
+
+
+// Move a slot's timers onto list, emptying the slot.
+static void slot_take(
+    sTIMER_WHEEL   *wheel,
+    unsigned int    level,
+    unsigned int    slot,
+    sSX_TIMER      *list
+    )
+{
+    sSX_TIMER  *head;
+
+
+    head = &wheel->slots[level][slot];
+
+    if(head->next != head)
+    {
+        head->next->prev    = list->prev;
+        list->prev->next    = head->next;
+        head->prev->next    = list;
+        list->prev          = head->prev;
+
+        list_init(head);
+    }
+
+    wheel->occupied[level] &= ~(1ULL << slot);
+}
+
+
+// Point timer_fd at the next event, if anyone polls it.
+static void fd_update(
+    sTIMER_WHEEL   *wheel
+    )
+{
+    struct itimerspec   spec;
+    unsigned long long  next;
+    unsigned long long  us;
+    int                 rv;
+
+
+    if(wheel->timer_fd < 0)
+    {
+        return;
+    }
+
+    next = next_tick_get(wheel);
+    if(next == wheel->fd_tick)
+    {
+        return;
+    }
+
+    memset(&spec, 0, sizeof(spec));
+
+    if(next != TICK_NONE)
+    {
+        us = wheel->base_us + next * SX_TIMER_TICK_US;
+
+        spec.it_value.tv_sec    = us / SX_CLOCK_US_PER_SEC;
+        spec.it_value.tv_nsec   = (us % SX_CLOCK_US_PER_SEC) * 1000;
+    }
+
+    // All zero disarms.
+    rv = timerfd_settime(wheel->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+    assert(rv == 0);
+
+    wheel->fd_tick = next;
+
+    wheel->stats.rearm_count++;
+}
+
+
+// --------------------------------------------------------
+// tick_process
+//      Advance to tick: cascade the higher level slots whose
+//      turn it is, coarsest first, then expire what is due.
+//
+static void tick_process(
+    sTIMER_WHEEL       *wheel,
+    unsigned long long  tick
+    )
+{
+    sSX_TIMER           list;
+    sSX_TIMER           expired;
+    sSX_TIMER          *timer;
+    unsigned int        level;
+    unsigned int        shift;
+
+
+    wheel->now = tick;
+
+    list_init(&expired);
+
+    for(level = SX_TIMER_LEVELS - 1; level > 0; level--)
+    {
+        shift = SX_TIMER_LEVEL_BITS * level;
+
+        if((tick & (LEVEL_SPAN(level) - 1)) != 0)
+        {
+            continue;
+        }
+
+        list_init(&list);
+
+        slot_take(wheel, level, (tick >> shift) & WHEEL_MASK, &list);
+
+        while(list.next != &list)
+        {
+            timer = list.next;
+
+            timer->next->prev = &list;
+            list.next = timer->next;
+
+            wheel->stats.cascade_count++;
+
+            if(timer->expires <= tick)
+            {
+                timer->next         = &expired;
+                timer->prev         = expired.prev;
+                expired.prev->next  = timer;
+                expired.prev        = timer;
+
+                timer->slot = SLOT_EXPIRING;
+            }
+            else
+            {
+                timer_place(wheel, timer);
+            }
+        }
+    }
+
+    slot_take(wheel, 0, tick & WHEEL_MASK, &expired);
+
+    // One at a time, a callback may arm or cancel any timer.
+    while(expired.next != &expired)
+    {
+        timer = expired.next;
+
+        timer->next->prev = &expired;
+        expired.next = timer->next;
+
+        timer->next = NULL;
+        timer->prev = NULL;
+
+        wheel->stats.expire_count++;
+
+        timer->cback(timer->arg);
+    }
+}
+
+
+// --------------------------------------------------------
+// sx_timer_wheel_create
+//      Create a wheel. Time starts now.
+//
+SX_TIMER_WHEEL sx_timer_wheel_create(
+    void
+    )
+{
+    sTIMER_WHEEL   *wheel;
+    unsigned int    level;
+    unsigned int    slot;
+
+
+    wheel = malloc(sizeof(sTIMER_WHEEL));
+    assert(wheel != NULL);
+
+    memset(wheel, 0, sizeof(sTIMER_WHEEL));
+
+    for(level = 0; level < SX_TIMER_LEVELS; level++)
+    {
+        for(slot = 0; slot < WHEEL_SLOTS; slot++)
+        {
+            list_init(&wheel->slots[level][slot]);
+        }
+    }
+
+    wheel->base_us  = sx_clock_mono_us();
+    wheel->timer_fd = -1;
+    wheel->fd_tick  = TICK_NONE;
+
+    return wheel;
+}
+
+
+// --------------------------------------------------------
+// sx_timer_wheel_fd_get
+//      timerfd for event loops, readable at the wheel's next
+//      event. Call sx_timer_wheel_run() when it is.
+//
+int sx_timer_wheel_fd_get(
+    SX_TIMER_WHEEL  wheel_id
+    )
+{
+    sTIMER_WHEEL   *wheel;
+
+
+    wheel = wheel_id;
+
+    if(wheel->timer_fd < 0)
+    {
+        wheel->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        assert(wheel->timer_fd >= 0);
+
+        fd_update(wheel);
+    }
+
+    return wheel->timer_fd;
+}
+
+
+// --------------------------------------------------------
+// sx_timer_wheel_next_get
+//      When to run the wheel next (us, sx_clock_mono_us()
+//      timebase), 0 if no timer is armed. For threads that wait
+//      with a timeout instead of polling the fd.
+//
+unsigned long long sx_timer_wheel_next_get(
+    SX_TIMER_WHEEL  wheel_id
+    )
+{
+    sTIMER_WHEEL       *wheel;
+    unsigned long long  next;
+
+
+    wheel = wheel_id;
+
+    next = next_tick_get(wheel);
+    if(next == TICK_NONE)
+    {
+        return 0;
+    }
+
+    return wheel->base_us + next * SX_TIMER_TICK_US;
+}
+
+
+// --------------------------------------------------------
+// sx_timer_wheel_run
+//      Run the callbacks of every timer due by now, on the
+//      calling thread.
+//
+void sx_timer_wheel_run(
+    SX_TIMER_WHEEL  wheel_id
+    )
+{
+    sTIMER_WHEEL       *wheel;
+    unsigned long long  target;
+    unsigned long long  next;
+    unsigned long long  count;
+    int                 rv;
+
+
+    wheel = wheel_id;
+
+    wheel->stats.run_count++;
+
+    target = (sx_clock_mono_us() - wheel->base_us) / SX_TIMER_TICK_US;
+
+    if((wheel->timer_fd >= 0) && (wheel->fd_tick <= target))
+    {
+        // Fired, clear it. Non-blocking, it may not have yet.
+        rv = read(wheel->timer_fd, &count, sizeof(count));
+        (void) rv;
+
+        wheel->fd_tick = TICK_NONE;
+    }
+
+    while(1)
+    {
+        next = next_tick_get(wheel);
+        if((next == TICK_NONE) || (next > target))
+        {
+            break;
+        }
+
+        tick_process(wheel, next);
+    }
+
+    if(target > wheel->now)
+    {
+        wheel->now = target;
+    }
+
+    fd_update(wheel);
+}
+
+
+// --------------------------------------------------------
+// sx_timer_init
+//      Bind a timer to a wheel and its callback, not armed. A
+//      cancelled timer may be bound to another wheel.
+//
+void sx_timer_init(
+    sSX_TIMER          *timer,
+    SX_TIMER_WHEEL      wheel,
+    fSX_TIMER_CBACK     cback,
+    void               *arg
+    )
+{
+    timer->next     = NULL;
+    timer->prev     = NULL;
+    timer->wheel    = wheel;
+    timer->slot     = SLOT_EXPIRING;
+    timer->expires  = 0;
+    timer->cback    = cback;
+    timer->arg      = arg;
+}
+
+
+// --------------------------------------------------------
+// sx_timer_arm
+//      Run the callback at expires_us (sx_clock_mono_us()
+//      timebase) or up to a tick later. An armed timer is moved.
+//      Expiries in the past fire on the next run.
+//
+void sx_timer_arm(
+    sSX_TIMER          *timer,
+    unsigned long long  expires_us
+    )
+{
+    sTIMER_WHEEL       *wheel;
+    unsigned long long  expires;
+
+
+    wheel = timer->wheel;
+
+    sx_timer_cancel(timer);
+
+    expires = 0;
+    if(expires_us > wheel->base_us)
+    {
+        // Round up, never early.
+        expires = (expires_us - wheel->base_us + SX_TIMER_TICK_US - 1) / SX_TIMER_TICK_US;
+    }
+
+    if(expires <= wheel->now)
+    {
+        expires = wheel->now + 1;
+    }
+
+    timer->expires = expires;
+
+    timer_place(wheel, timer);
+
+    wheel->stats.arm_count++;
+
+    if(expires < wheel->fd_tick)
+    {
+        fd_update(wheel);
+    }
+}
+
+
+// --------------------------------------------------------
+// sx_timer_cancel
+//      Disarm a timer, a no-op if it is not armed.
+//
+void sx_timer_cancel(
+    sSX_TIMER      *timer
+    )
+{
+    sTIMER_WHEEL   *wheel;
+    unsigned int    level;
+    unsigned int    slot;
+
+
+    if(timer->next == NULL)
+    {
+        return;
+    }
+
+    wheel = timer->wheel;
+
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+
+    if(timer->slot != SLOT_EXPIRING)
+    {
+        level   = timer->slot / WHEEL_SLOTS;
+        slot    = timer->slot % WHEEL_SLOTS;
+
+        if(wheel->slots[level][slot].next == &wheel->slots[level][slot])
+        {
+            wheel->occupied[level] &= ~(1ULL << slot);
+        }
+    }
+
+    timer->next = NULL;
+    timer->prev = NULL;
+
+    // timer_fd may fire early now, the run finds nothing due.
+    wheel->stats.cancel_count++;
+}
+
+
+unsigned char sx_timer_pending(
+    const sSX_TIMER    *timer
+    )
+{
+    return timer->next != NULL;
+}
+
+
+void sx_timer_wheel_stats_get(
+    SX_TIMER_WHEEL      wheel,
+    sSX_TIMER_STATS    *stats
+    )
+{
+    *stats = ((sTIMER_WHEEL *) wheel)->stats;
+}
+
+
+void sx_timer_wheel_stats_log(
+    SX_TIMER_WHEEL      wheel,
+    const char         *name
+    )
+{
+    sSX_TIMER_STATS     stats;
+
+
+    sx_timer_wheel_stats_get(wheel, &stats);
+
+    logger_log("(sx_timer): %s: armed = %d, cancelled = %d, expired = %d, cascaded = %d, runs = %d, fd updates = %d",
+               name,
+               stats.arm_count,
+               stats.cancel_count,
+               stats.expire_count,
+               stats.cascade_count,
+               stats.run_count,
+               stats.rearm_count);
+}
+
+
+typedef struct
+{
+    sSX_TIMER           timer;      ///< Under test.
+    unsigned long long  due_us;     ///< Requested expiry.
+    unsigned long long  late_us;    ///< How late it ran.
+
+} sTIMER_BENCH;
+
+
+// Benchmark callbacks run.
+static unsigned int f_bench_fired;
+
+
+static void bench_cback(
+    void   *arg
+    )
+{
+    sTIMER_BENCH   *bench;
+
+
+    bench = arg;
+
+    bench->late_us = sx_clock_mono_us() - bench->due_us;
+
+    f_bench_fired++;
+}
+
+
+// --------------------------------------------------------
+// sx_timer_benchmark
+//      Time arming and cancelling timers spread over 4 s, rounds
+//      times over. Then arm them over 100 ms, wait them out on
+//      the timerfd and log how many wakeups that took and how
+//      late the callbacks ran.
+//
+void sx_timer_benchmark(
+    unsigned int    timers,
+    unsigned int    rounds
+    )
+{
+    SX_TIMER_WHEEL      wheel;
+    sTIMER_BENCH       *bench;
+    sSX_TIMER_STATS     stats;
+    struct pollfd       pfd;
+    struct timespec     start;
+    struct timespec     end;
+    unsigned long long  now;
+    unsigned long long  late_max;
+    unsigned int        seed;
+    unsigned int        wakeups;
+    unsigned int        round;
+    unsigned int        i;
+    double              sec;
+
+
+    assert(timers > 0);
+
+    wheel   = sx_timer_wheel_create();
+    bench   = malloc(timers * sizeof(sTIMER_BENCH));
+    seed    = 1;
+
+    for(i = 0; i < timers; i++)
+    {
+        sx_timer_init(&bench[i].timer, wheel, bench_cback, &bench[i]);
+    }
+
+    now = sx_clock_mono_us();
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for(round = 0; round < rounds; round++)
+    {
+        for(i = 0; i < timers; i++)
+        {
+            sx_timer_arm(&bench[i].timer, now + rand_r(&seed) % (4 * SX_CLOCK_US_PER_SEC));
+        }
+
+        for(i = 0; i < timers; i++)
+        {
+            sx_timer_cancel(&bench[i].timer);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    sec = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    // Now let them fire.
+    now = sx_clock_mono_us();
+
+    for(i = 0; i < timers; i++)
+    {
+        bench[i].due_us = now + rand_r(&seed) % 100000;
+
+        sx_timer_arm(&bench[i].timer, bench[i].due_us);
+    }
+
+    pfd.fd      = sx_timer_wheel_fd_get(wheel);
+    pfd.events  = POLLIN;
+
+    wakeups         = 0;
+    f_bench_fired   = 0;
+
+    while(f_bench_fired < timers)
+    {
+        poll(&pfd, 1, -1);
+
+        wakeups++;
+
+        sx_timer_wheel_run(wheel);
+    }
+
+    late_max = 0;
+    for(i = 0; i < timers; i++)
+    {
+        if(bench[i].late_us > late_max)
+        {
+            late_max = bench[i].late_us;
+        }
+    }
+
+    sx_timer_wheel_stats_get(wheel, &stats);
+
+    logger_log("(sx_timer): %d timers, arm + cancel = %.0f ns, fired over 100 ms in %d wakeups, latest %llu us late, cascaded = %d",
+               timers,
+               sec * 1e9 / ((double) timers * rounds),
+               wakeups,
+               late_max,
+               stats.cascade_count);
+
+    free(bench);
+}
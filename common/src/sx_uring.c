@@ -0,0 +1,686 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <assert.h>
+
+#if !defined(SX_NO_IO_URING)
+#include <linux/io_uring.h>
+#endif
+
+#include "logger.h"
+#include "sx_uring.h"
+
+
+// Selected with sx_uring_init().
+static unsigned char f_enabled;
+
+
+// --------------------------------------------------------
+// sx_uring_init
+//      Select the io_uring backend. Must be called before any
+//      manager is initialized.
+//
+void sx_uring_init(
+    void
+    )
+{
+    f_enabled = 1;
+}
+
+
+// --------------------------------------------------------
+// sx_uring_enabled
+//      Was the io_uring backend selected? Rings may still be
+//      unavailable.
+//
+unsigned char sx_uring_enabled(
+    void
+    )
+{
+    return f_enabled;
+}
+
+
+#if !defined(SX_NO_IO_URING)
+
+// Ring mapped from the kernel. The SQ index array maps slot i to SQE
+// i once at setup, queueing an SQE only moves the tail.
+typedef struct
+{
+    int                 fd;             ///< io_uring instance.
+    unsigned int        entries;        ///< SQ slots.
+
+    unsigned int       *sq_head;        ///< Advanced by the kernel.
+    unsigned int       *sq_tail;        ///< Advanced by us.
+    unsigned int        sq_mask;
+    struct io_uring_sqe*sqes;
+    unsigned int        sq_pending;     ///< Queued, not submitted yet.
+
+    unsigned int       *cq_head;        ///< Advanced by us.
+    unsigned int       *cq_tail;        ///< Advanced by the kernel.
+    unsigned int        cq_mask;
+    struct io_uring_cqe*cqes;
+
+    char               *rings;          ///< SQ and CQ rings, one mapping.
+    size_t              rings_len;
+    size_t              sqes_len;
+
+    sSX_URING_STATS     stats;
+
+} sURING;
+
+
+static int uring_setup(
+    unsigned int            entries,
+    struct io_uring_params *params
+    )
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+
+static int uring_enter(
+    int             fd,
+    unsigned int    to_submit,
+    unsigned int    min_complete,
+    unsigned int    flags
+    )
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+
+static int uring_register(
+    int             fd,
+    unsigned int    opcode,
+    const void     *arg,
+    unsigned int    count
+    )
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+
+// Next free SQE, cleared, or NULL if the SQ is full.
+static struct io_uring_sqe * sqe_get(
+    sURING     *ring
+    )
+{
+    struct io_uring_sqe    *sqe;
+    unsigned int            head;
+    unsigned int            tail;
+
+
+    head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    tail = *ring->sq_tail;
+
+    if(tail - head >= ring->entries)
+    {
+        return NULL;
+    }
+
+    sqe = &ring->sqes[tail & ring->sq_mask];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+    return sqe;
+}
+
+
+// Hand the SQE from sqe_get() to the kernel's view of the SQ.
+static void sqe_commit(
+    sURING     *ring
+    )
+{
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+
+    ring->sq_pending++;
+    ring->stats.sqe_count++;
+}
+
+
+// --------------------------------------------------------
+// sx_uring_create
+//      Ring with room for entries queued operations, NULL when
+//      the backend isn't selected or the kernel refuses.
+//
+SX_URING sx_uring_create(
+    unsigned int    entries
+    )
+{
+    struct io_uring_params  params;
+    sURING                 *ring;
+    unsigned int           *sq_array;
+    size_t                  sq_len;
+    size_t                  cq_len;
+    unsigned int            i;
+    int                     fd;
+
+
+    if(!f_enabled)
+    {
+        return NULL;
+    }
+
+    memset(&params, 0, sizeof(params));
+
+    fd = uring_setup(entries, &params);
+    if(fd < 0)
+    {
+        logger_log("(sx_uring): io_uring unavailable [errno = %d]", errno);
+
+        return NULL;
+    }
+
+    // Needed for an SQ and CQ in one mapping, 5.4 and later.
+    if(!(params.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        logger_log("(sx_uring): io_uring too old [features = 0x%x]", params.features);
+
+        close(fd);
+
+        return NULL;
+    }
+
+    ring = malloc(sizeof(sURING));
+    if(ring == NULL)
+    {
+        logger_log("(sx_uring): out of memory");
+
+        goto error_close;
+    }
+
+    memset(ring, 0, sizeof(sURING));
+
+    sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if(cq_len > sq_len)
+    {
+        sq_len = cq_len;
+    }
+
+    ring->rings = mmap(NULL, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if(ring->rings == MAP_FAILED)
+    {
+        logger_log("(sx_uring): ring mmap failed [errno = %d]", errno);
+
+        goto error_free;
+    }
+
+    ring->rings_len = sq_len;
+    ring->sqes_len  = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if(ring->sqes == MAP_FAILED)
+    {
+        logger_log("(sx_uring): sqe mmap failed [errno = %d]", errno);
+
+        goto error_unmap;
+    }
+
+    ring->fd        = fd;
+    ring->entries   = params.sq_entries;
+
+    ring->sq_head   = (unsigned int *) (ring->rings + params.sq_off.head);
+    ring->sq_tail   = (unsigned int *) (ring->rings + params.sq_off.tail);
+    ring->sq_mask   = *(unsigned int *) (ring->rings + params.sq_off.ring_mask);
+    sq_array        = (unsigned int *) (ring->rings + params.sq_off.array);
+
+    ring->cq_head   = (unsigned int *) (ring->rings + params.cq_off.head);
+    ring->cq_tail   = (unsigned int *) (ring->rings + params.cq_off.tail);
+    ring->cq_mask   = *(unsigned int *) (ring->rings + params.cq_off.ring_mask);
+    ring->cqes      = (struct io_uring_cqe *) (ring->rings + params.cq_off.cqes);
+
+    for(i = 0; i < ring->entries; i++)
+    {
+        sq_array[i] = i;
+    }
+
+    return ring;
+
+error_unmap:
+
+    munmap(ring->rings, sq_len);
+
+error_free:
+
+    free(ring);
+
+error_close:
+
+    close(fd);
+
+    return NULL;
+}
+
+
+// --------------------------------------------------------
+// sx_uring_destroy
+//      Drop the ring's fixed files and buffers, which also lets
+//      go of the connections in it, then the ring. Whatever is
+//      still queued is abandoned.
+//
+void sx_uring_destroy(
+    SX_URING        ring
+    )
+{
+    sURING     *r = ring;
+
+
+    // Either may not have been registered.
+    uring_register(r->fd, IORING_UNREGISTER_FILES, NULL, 0);
+    uring_register(r->fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+
+    munmap(r->sqes, r->sqes_len);
+    munmap(r->rings, r->rings_len);
+
+    close(r->fd);
+
+    free(r);
+}
+
+
+// --------------------------------------------------------
+// sx_uring_files_register
+//      Register the fixed file table, operations name a file by
+//      its index. -1 leaves a slot empty for sx_uring_file_update().
+//
+//      Returns 0, or -1 with errno set.
+//
+int sx_uring_files_register(
+    SX_URING        ring,
+    const int      *fds,
+    unsigned int    count
+    )
+{
+    sURING     *r = ring;
+
+
+    return (uring_register(r->fd, IORING_REGISTER_FILES, fds, count) < 0) ? -1 : 0;
+}
+
+
+// --------------------------------------------------------
+// sx_uring_file_update
+//      Put fd in a fixed file slot, -1 empties it. The ring holds a
+//      reference to the file, empty the slot before closing fd or
+//      the connection stays up.
+//
+//      Returns 0, or -1 with errno set.
+//
+int sx_uring_file_update(
+    SX_URING        ring,
+    unsigned int    index,
+    int             fd
+    )
+{
+    struct io_uring_files_update    update;
+    sURING                         *r = ring;
+
+
+    memset(&update, 0, sizeof(update));
+
+    update.offset   = index;
+    update.fds      = (unsigned long) &fd;
+
+    return (uring_register(r->fd, IORING_REGISTER_FILES_UPDATE, &update, 1) < 0) ? -1 : 0;
+}
+
+
+// --------------------------------------------------------
+// sx_uring_buffers_register
+//      Pin buffers for sx_uring_write_fixed_queue(), named by their
+//      index in iov.
+//
+//      Returns 0, or -1 with errno set.
+//
+int sx_uring_buffers_register(
+    SX_URING            ring,
+    const struct iovec *iov,
+    unsigned int        count
+    )
+{
+    sURING     *r = ring;
+
+
+    return (uring_register(r->fd, IORING_REGISTER_BUFFERS, iov, count) < 0) ? -1 : 0;
+}
+
+
+// --------------------------------------------------------
+// sx_uring_sendmsg_queue
+//      Queue a non-blocking sendmsg() on a fixed file. msg and all
+//      it points to must stay put until the completion is taken.
+//      Linked to the next operation queued, that one only runs if
+//      this succeeds and completes -ECANCELED otherwise.
+//
+//      Returns 0 if the SQ is full.
+//
+unsigned char sx_uring_sendmsg_queue(
+    SX_URING            ring,
+    unsigned int        file,
+    const struct msghdr*msg,
+    unsigned char       link,
+    unsigned long long  user_data
+    )
+{
+    struct io_uring_sqe    *sqe;
+    sURING                 *r = ring;
+
+
+    sqe = sqe_get(r);
+    if(sqe == NULL)
+    {
+        return 0;
+    }
+
+    sqe->opcode     = IORING_OP_SENDMSG;
+    sqe->flags      = IOSQE_FIXED_FILE | (link ? IOSQE_IO_LINK : 0);
+    sqe->fd         = file;
+    sqe->addr       = (unsigned long) msg;
+    sqe->len        = 1;
+
+    // A full socket buffer completes with -EAGAIN instead of parking
+    // the operation until there is room.
+    sqe->msg_flags  = MSG_DONTWAIT;
+    sqe->user_data  = user_data;
+
+    sqe_commit(r);
+
+    return 1;
+}
+
+
+// --------------------------------------------------------
+// sx_uring_write_fixed_queue
+//      Queue a write() of len bytes at data, within registered
+//      buffer buf, to a fixed file.
+//
+//      Returns 0 if the SQ is full.
+//
+unsigned char sx_uring_write_fixed_queue(
+    SX_URING            ring,
+    unsigned int        file,
+    unsigned int        buf,
+    const void         *data,
+    unsigned int        len,
+    unsigned long long  user_data
+    )
+{
+    struct io_uring_sqe    *sqe;
+    sURING                 *r = ring;
+
+
+    sqe = sqe_get(r);
+    if(sqe == NULL)
+    {
+        return 0;
+    }
+
+    sqe->opcode     = IORING_OP_WRITE_FIXED;
+    sqe->flags      = IOSQE_FIXED_FILE;
+    sqe->fd         = file;
+    sqe->addr       = (unsigned long) data;
+    sqe->len        = len;
+    sqe->buf_index  = buf;
+    sqe->user_data  = user_data;
+
+    sqe_commit(r);
+
+    return 1;
+}
+
+
+// --------------------------------------------------------
+// sx_uring_submit
+//      Submit everything queued in one io_uring_enter(), and wait
+//      until at least wait of the operations taken can be reaped.
+//      The kernel stops short only on an SQE it can't read, those
+//      from there on stay queued.
+//
+//      Returns the number of operations the kernel took, or -1
+//      with errno set if it took none.
+//
+int sx_uring_submit(
+    SX_URING        ring,
+    unsigned int    wait
+    )
+{
+    sURING         *r = ring;
+    unsigned int    submitted;
+    int             rv;
+
+
+    while(1)
+    {
+        rv = uring_enter(r->fd, r->sq_pending, wait, (wait != 0) ? IORING_ENTER_GETEVENTS : 0);
+
+        r->stats.enter_count++;
+
+        if(rv >= 0)
+        {
+            break;
+        }
+
+        if(errno != EINTR)
+        {
+            return -1;
+        }
+    }
+
+    submitted       = rv;
+    r->sq_pending  -= submitted;
+
+    if(wait > submitted)
+    {
+        wait = submitted;
+    }
+
+    // A short submission returns without waiting, as does a signal
+    // once something was submitted.
+    while(__atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE) - *r->cq_head < wait)
+    {
+        rv = uring_enter(r->fd, 0, wait, IORING_ENTER_GETEVENTS);
+
+        r->stats.enter_count++;
+
+        assert((rv >= 0) || (errno == EINTR));
+    }
+
+    return submitted;
+}
+
+
+// --------------------------------------------------------
+// sx_uring_reap
+//      Take up to max completions, in the order posted.
+//
+//      Returns the number taken.
+//
+unsigned int sx_uring_reap(
+    SX_URING        ring,
+    sSX_URING_CQE  *cqes,
+    unsigned int    max
+    )
+{
+    struct io_uring_cqe    *cqe;
+    sURING                 *r = ring;
+    unsigned int            head;
+    unsigned int            tail;
+    unsigned int            count;
+
+
+    head = *r->cq_head;
+    tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+
+    for(count = 0; (count < max) && (head != tail); count++, head++)
+    {
+        cqe = &r->cqes[head & r->cq_mask];
+
+        cqes[count].user_data   = cqe->user_data;
+        cqes[count].res         = cqe->res;
+
+        r->stats.error_count += (cqe->res < 0);
+    }
+
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+
+    r->stats.cqe_count += count;
+
+    return count;
+}
+
+
+void sx_uring_stats_get(
+    SX_URING            ring,
+    sSX_URING_STATS    *stats
+    )
+{
+    *stats = ((sURING *) ring)->stats;
+}
+
+#else // SX_NO_IO_URING
+
+// Built without io_uring, there are no rings to use.
+SX_URING sx_uring_create(
+    unsigned int    entries
+    )
+{
+    if(f_enabled)
+    {
+        logger_log("(sx_uring): io_uring not built in, SX_IO_URING=0");
+    }
+
+    return NULL;
+}
+
+
+void sx_uring_destroy(
+    SX_URING        ring
+    )
+{
+    assert(0);
+}
+
+
+int sx_uring_files_register(
+    SX_URING        ring,
+    const int      *fds,
+    unsigned int    count
+    )
+{
+    assert(0);
+
+    return -1;
+}
+
+
+int sx_uring_file_update(
+    SX_URING        ring,
+    unsigned int    index,
+    int             fd
+    )
+{
+    assert(0);
+
+    return -1;
+}
+
+
+int sx_uring_buffers_register(
+    SX_URING            ring,
+    const struct iovec *iov,
+    unsigned int        count
+    )
+{
+    assert(0);
+
+    return -1;
+}
+
+
+unsigned char sx_uring_sendmsg_queue(
+    SX_URING            ring,
+    unsigned int        file,
+    const struct msghdr*msg,
+    unsigned char       link,
+    unsigned long long  user_data
+    )
+{
+    assert(0);
+
+    return 0;
+}
+
+
+unsigned char sx_uring_write_fixed_queue(
+    SX_URING            ring,
+    unsigned int        file,
+    unsigned int        buf,
+    const void         *data,
+    unsigned int        len,
+    unsigned long long  user_data
+    )
+{
+    assert(0);
+
+    return 0;
+}
+
+
+int sx_uring_submit(
+    SX_URING        ring,
+    unsigned int    wait
+    )
+{
+    assert(0);
+
+    return -1;
+}
+
+
+unsigned int sx_uring_reap(
+    SX_URING        ring,
+    sSX_URING_CQE  *cqes,
+    unsigned int    max
+    )
+{
+    assert(0);
+
+    return 0;
+}
+
+
+void sx_uring_stats_get(
+    SX_URING            ring,
+    sSX_URING_STATS    *stats
+    )
+{
+    assert(0);
+}
+
+#endif // SX_NO_IO_URING
+
+
+void sx_uring_stats_log(
+    SX_URING        ring,
+    const char     *name
+    )
+{
+    sSX_URING_STATS     stats;
+
+
+    sx_uring_stats_get(ring, &stats);
+
+    logger_log("(sx_uring): %s: sqes = %d, enters = %d, sqes per enter = %.1f, cqes = %d, errors = %d",
+               name,
+               stats.sqe_count,
+               stats.enter_count,
+               (stats.enter_count != 0) ? (double) stats.sqe_count / stats.enter_count : 0.0,
+               stats.cqe_count,
+               stats.error_count);
+}
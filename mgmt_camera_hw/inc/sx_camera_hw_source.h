@@ -0,0 +1,101 @@
+#ifndef _SX_CAMERA_HW_SOURCE_H_
+#define _SX_CAMERA_HW_SOURCE_H_
+
+#include <time.h>
+
+#include "sx_mgmt_camera_hw.h"
+
+
+// Frame rate timestamps assume when a source runs unpaced.
+#define SX_CAMERA_HW_FPS_NOMINAL    30
+
+
+// Access unit playout clock shared by the file and generated sources.
+typedef struct
+{
+    unsigned int        fps;            ///< Playout rate, 0 = as fast as drained.
+    struct timespec     deadline;       ///< Next access unit release time.
+    unsigned long long  pts;            ///< Capture time of the access unit just released (us).
+    unsigned long long  pts_start;      ///< Clock start time (us).
+    unsigned long long  frame_count;    ///< Access units released.
+
+} sSX_CAMERA_HW_PACE;
+
+
+extern void sx_camera_hw_pace_init(
+    sSX_CAMERA_HW_PACE         *pace,
+    unsigned int                fps
+    );
+
+extern void sx_camera_hw_pace_wait(
+    sSX_CAMERA_HW_PACE         *pace
+    );
+
+
+// Frame source backends. Each backend hands sSX_CAMERA_HW_BUFFER NAL units
+// (without start code) to sx_camera_hw_push() from its own thread.
+
+extern sSX_CAMERA_HW_BUFFER * sx_camera_hw_buffer_alloc(
+    unsigned int                size
+    );
+
+extern void sx_camera_hw_buffer_append(
+    sSX_CAMERA_HW_BUFFER       *hw_buf,
+    const unsigned char        *data,
+    unsigned int                len
+    );
+
+extern void sx_camera_hw_push(
+    sSX_CAMERA_HW_BUFFER       *hw_buf
+    );
+
+extern unsigned char sx_camera_hw_keyframe_pending(
+    void
+    );
+
+extern void sx_camera_hw_mmal_open(
+    const sSX_CAMERA_HW_CONFIG *config
+    );
+
+extern void sx_camera_hw_mmal_keyframe_request(
+    void
+    );
+
+extern void sx_camera_hw_replay_open(
+    const sSX_CAMERA_HW_CONFIG *config
+    );
+
+extern void sx_camera_hw_synth_open(
+    const sSX_CAMERA_HW_CONFIG *config
+    );
+
+
+// Stub buffer header pool with MMAL pool semantics: a fixed number of
+// preallocated payload buffers, get blocks while all of them are held
+// downstream. Lets the zero-copy path run without the Pi userland.
+
+typedef struct sSX_CAMERA_HW_BUFHDR
+{
+    struct sSX_CAMERA_HW_BUFHDR    *next;           ///< Free list link.
+    void                           *pool;           ///< Owning pool.
+    unsigned char                  *data;           ///< Payload.
+    unsigned int                    alloc_size;     ///< Payload capacity.
+    unsigned int                    length;         ///< Payload in use.
+
+} sSX_CAMERA_HW_BUFHDR;
+
+
+extern void * sx_camera_hw_bufhdr_pool_create(
+    unsigned int                num,
+    unsigned int                size
+    );
+
+extern sSX_CAMERA_HW_BUFHDR * sx_camera_hw_bufhdr_get(
+    void                       *pool
+    );
+
+extern void sx_camera_hw_bufhdr_release(
+    sSX_CAMERA_HW_BUFHDR       *hdr
+    );
+
+#endif // #ifndef _SX_CAMERA_HW_SOURCE_H_
@@ -1,21 +1,116 @@
 #ifndef _SW_CAMERA_HW_H_
 #define _SW_CAMERA_HW_H_
 
-#define SX_CAMERA_HW_NAL_LEN_MAX    (65536*2)
+#include "sx_seg.h"
+#include "sx_queue.h"
 
-typedef struct
+// Sanity bound on a NAL unit. Payloads are segment chains, this only
+// stops a stream without start codes from growing without end.
+#define SX_CAMERA_HW_NAL_LEN_MAX    (8*1024*1024)
+
+// Buffers that may be held downstream at once in zero-copy mode.
+#define SX_CAMERA_HW_IN_FLIGHT_MAX  16
+
+// NAL units queued between a source and the video manager by default.
+#define SX_CAMERA_HW_QUEUE_LEN      64
+
+// Slices per frame at most, one per macroblock row at 720p.
+#define SX_CAMERA_HW_SLICES_MAX     45
+
+// A keyframe request with no IDR after this long is reissued, in case
+// the backend lost it (us).
+#define SX_CAMERA_HW_KEYFRAME_RETRY_US  1000000
+
+typedef struct sSX_CAMERA_HW_BUFFER
 {
-    unsigned char   nal[SX_CAMERA_HW_NAL_LEN_MAX];
-    unsigned int    nal_len;
+    sSX_SEG         seg;            ///< NAL unit (no start code), first segment of the chain.
+    unsigned int    nal_len;        ///< NAL unit length, all segments.
+    unsigned char   flags;          ///< Access unit boundaries, SX_NAL_FLAG_xxx.
+    unsigned long long pts;         ///< Capture time of the access unit (us, sx_clock_mono_us() timebase).
+
+    void          (*release)(struct sSX_CAMERA_HW_BUFFER *hw_buf);
+    void           *hdr;            ///< Retained backend buffer header, zero-copy only.
+
+    unsigned char   data[];         ///< Copy mode first segment storage.
 
 } sSX_CAMERA_HW_BUFFER;
 
+
+typedef enum
+{
+    SX_CAMERA_HW_SOURCE_MMAL,           ///< Pi camera through the MMAL encoder.
+    SX_CAMERA_HW_SOURCE_REPLAY,         ///< Annex-B file or FIFO replay.
+    SX_CAMERA_HW_SOURCE_SYNTHETIC,      ///< Generated SPS/PPS/IDR/P load pattern.
+
+} eSX_CAMERA_HW_SOURCE;
+
+
+typedef struct
+{
+    eSX_CAMERA_HW_SOURCE    source;         ///< Frame source.
+    unsigned int            fps;            ///< Playout rate, 0 = as fast as possible.
+    unsigned char           zero_copy;      ///< Hand out retained buffer headers, no copy.
+    unsigned char           low_latency;    ///< Camera encodes slices, each forwarded once complete.
+    unsigned int            slices;         ///< Slice NAL units per frame (synthetic, low-latency camera).
+    unsigned int            queue_len;      ///< NAL units queued at most, 0 = unbounded.
+    eSX_QUEUE_POLICY        queue_policy;   ///< What a full queue does with the next NAL unit.
+
+    const char             *replay_path;    ///< Annex-B .h264 file or FIFO.
+    unsigned char           replay_loop;    ///< Restart at end of stream.
+
+    unsigned int            synth_bitrate;  ///< Average bits per second.
+    unsigned int            synth_gop;      ///< Frames per GOP (IDR period).
+    unsigned int            synth_idr_ratio;///< IDR size as a multiple of a P frame.
+    unsigned int            synth_jitter;   ///< Frame size spread, +/- percent.
+
+} sSX_CAMERA_HW_CONFIG;
+
+
+// Invoked on the source thread whenever a NAL unit is ready for
+// sx_camera_hw_get().
+typedef void (*fSX_CAMERA_HW_CBACK) (
+    void   *arg
+);
+
+
+extern void sx_camera_hw_config_get(
+    sSX_CAMERA_HW_CONFIG   *config
+    );
+
+extern void sx_camera_hw_config_set(
+    const sSX_CAMERA_HW_CONFIG *config
+    );
+
 extern void sx_camera_hw_open(
-    void
-    ); 
+    fSX_CAMERA_HW_CBACK     user_cback,
+    void                   *user_arg
+    );
 
 extern sSX_CAMERA_HW_BUFFER * sx_camera_hw_get(
     void
     );
 
+extern unsigned int sx_camera_hw_get_many(
+    sSX_CAMERA_HW_BUFFER  **hw_bufs,
+    unsigned int            count_max
+    );
+
+extern void sx_camera_hw_release(
+    sSX_CAMERA_HW_BUFFER   *hw_buf
+    );
+
+extern void sx_camera_hw_keyframe_request(
+    void
+    );
+
+extern unsigned char sx_camera_hw_is_key(
+    const unsigned char    *nal,
+    unsigned int            nal_len,
+    unsigned char           flags
+    );
+
+extern void sx_camera_hw_stats_log(
+    void
+    );
+
 #endif // #ifndef _SW_CAMERA_HW_H_
@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "sx_camera_hw_source.h"
+
+
+// Buffer header pool.
+typedef struct
+{
+    pthread_mutex_t         lock;           ///< Free list lock.
+    pthread_cond_t          cond;           ///< Signalled on release.
+    sSX_CAMERA_HW_BUFHDR   *free_list;      ///< Available headers.
+    unsigned int            num;            ///< Headers in the pool.
+    unsigned int            in_flight;      ///< Headers handed out.
+
+} sCAMERA_HW_BUFHDR_POOL;
+
+
+// --------------------------------------------------------
+// sx_camera_hw_bufhdr_pool_create
+//      Create a pool of num headers with size byte payloads.
+//
+void * sx_camera_hw_bufhdr_pool_create(
+    unsigned int    num,
+    unsigned int    size
+    )
+{
+    sCAMERA_HW_BUFHDR_POOL *pool;
+    sSX_CAMERA_HW_BUFHDR   *hdr;
+    unsigned int            i;
+
+
+    pool = malloc(sizeof(sCAMERA_HW_BUFHDR_POOL));
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    pool->free_list = NULL;
+    pool->num       = num;
+    pool->in_flight = 0;
+
+    for(i = 0; i < num; i++)
+    {
+        hdr = malloc(sizeof(sSX_CAMERA_HW_BUFHDR));
+
+        hdr->pool       = pool;
+        hdr->data       = malloc(size);
+        hdr->alloc_size = size;
+        hdr->length     = 0;
+
+        hdr->next       = pool->free_list;
+        pool->free_list = hdr;
+    }
+
+    return pool;
+}
+
+
+// --------------------------------------------------------
+// sx_camera_hw_bufhdr_get
+//      Get a header, waiting for a release if the pool is empty.
+//
+sSX_CAMERA_HW_BUFHDR * sx_camera_hw_bufhdr_get(
+    void   *pool_id
+    )
+{
+    sCAMERA_HW_BUFHDR_POOL *pool;
+    sSX_CAMERA_HW_BUFHDR   *hdr;
+
+
+    pool = pool_id;
+
+    pthread_mutex_lock(&pool->lock);
+
+    while(pool->free_list == NULL)
+    {
+        // Everything is held downstream, same as a starved encoder.
+        pthread_cond_wait(&pool->cond, &pool->lock);
+    }
+
+    hdr             = pool->free_list;
+    pool->free_list = hdr->next;
+
+    pool->in_flight++;
+
+    pthread_mutex_unlock(&pool->lock);
+
+    hdr->next   = NULL;
+    hdr->length = 0;
+
+    return hdr;
+}
+
+
+// --------------------------------------------------------
+// sx_camera_hw_bufhdr_release
+//      Return a header to its pool.
+//
+void sx_camera_hw_bufhdr_release(
+    sSX_CAMERA_HW_BUFHDR   *hdr
+    )
+{
+    sCAMERA_HW_BUFHDR_POOL *pool;
+
+
+    pool = hdr->pool;
+
+    pthread_mutex_lock(&pool->lock);
+
+    assert(pool->in_flight > 0);
+
+    hdr->next       = pool->free_list;
+    pool->free_list = hdr;
+
+    pool->in_flight--;
+
+    pthread_cond_signal(&pool->cond);
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
@@ -0,0 +1,83 @@
+#include <time.h>
+
+#include "sx_clock.h"
+#include "sx_camera_hw_source.h"
+
+#define NS_PER_SEC              1000000000LL
+
+
+// Advance a timespec by nanoseconds.
+static void timespec_add_ns(
+    struct timespec    *ts,
+    long long           ns
+    )
+{
+    ns += ts->tv_nsec;
+
+    ts->tv_sec  += ns / NS_PER_SEC;
+    ts->tv_nsec  = ns % NS_PER_SEC;
+}
+
+
+// --------------------------------------------------------
+// sx_camera_hw_pace_init
+//      Start the frame clock now.
+//
+void sx_camera_hw_pace_init(
+    sSX_CAMERA_HW_PACE *pace,
+    unsigned int        fps
+    )
+{
+    pace->fps = fps;
+
+    clock_gettime(CLOCK_MONOTONIC, &pace->deadline);
+
+    // First access unit is stamped one frame period from now.
+    pace->pts_start     = sx_clock_mono_us();
+    pace->pts           = pace->pts_start;
+    pace->frame_count   = 0;
+}
+
+
+// --------------------------------------------------------
+// sx_camera_hw_pace_wait
+//      Hold the next access unit until its playout time and
+//      stamp it with that time in pace->pts. With fps == 0 return
+//      at once, the push blocks on a full queue instead, and
+//      timestamps advance at SX_CAMERA_HW_FPS_NOMINAL.
+//
+void sx_camera_hw_pace_wait(
+    sSX_CAMERA_HW_PACE *pace
+    )
+{
+    struct timespec now;
+
+
+    if(pace->fps == 0)
+    {
+        // From the frame count, so us truncation does not accumulate.
+        pace->frame_count++;
+
+        pace->pts = pace->pts_start + pace->frame_count * SX_CLOCK_US_PER_SEC / SX_CAMERA_HW_FPS_NOMINAL;
+
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    timespec_add_ns(&pace->deadline, NS_PER_SEC / pace->fps);
+
+    if(   (pace->deadline.tv_sec < now.tv_sec)
+       || (   (pace->deadline.tv_sec == now.tv_sec)
+           && (pace->deadline.tv_nsec < now.tv_nsec)))
+    {
+        // Fell behind (slow source or stalled FIFO), resync rather than burst.
+        pace->deadline = now;
+    }
+    else
+    {
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &pace->deadline, NULL);
+    }
+
+    pace->pts = pace->deadline.tv_sec * SX_CLOCK_US_PER_SEC + pace->deadline.tv_nsec / 1000;
+}
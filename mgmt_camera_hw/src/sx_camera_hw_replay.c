@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "logger.h"
+#include "sx_nal_scan.h"
+#include "sx_mgmt_camera_hw.h"
+#include "sx_camera_hw_source.h"
+
+#define REPLAY_READ_SIZE        65536
+#define REPLAY_NAL_SIZE_INIT    4096
+
+
+// Replay control block.
+typedef struct
+{
+    sSX_CAMERA_HW_CONFIG    config;         ///< Source configuration.
+    pthread_t               thread_id;      ///< Replay thread.
+
+    sSX_CAMERA_HW_BUFFER   *hw_buf;         ///< NAL unit being assembled.
+    unsigned char           in_nal;         ///< Start code seen, hw_buf is live.
+    unsigned int            zero_count;     ///< Zero bytes ending the last chunk.
+    unsigned char           truncated;      ///< Current NAL exceeded max length.
+
+    sSX_CAMERA_HW_BUFFER   *pending;        ///< Last NAL unit, held until the next one tells if it ends the access unit.
+    sSX_NAL_AU              au;             ///< Access unit tracker.
+    sSX_CAMERA_HW_PACE      pace;           ///< Access unit playout clock.
+    unsigned char           seeking;        ///< Keyframe requested, dropping up to the next SPS or IDR.
+    unsigned int            nal_count;      ///< NAL units queued.
+    unsigned int            au_count;       ///< Access units parsed.
+    unsigned int            skip_count;     ///< NAL units dropped seeking to an IDR.
+
+} sCAMERA_HW_REPLAY_CBLK;
+
+
+// Replay control block.
+static sCAMERA_HW_REPLAY_CBLK f_cblk;
+
+
+// Queue the held NAL unit, pacing at each access unit start.
+static void pending_push(
+    unsigned char   au_end
+    )
+{
+    sSX_CAMERA_HW_BUFFER   *hw_buf;
+
+
+    hw_buf = f_cblk.pending;
+    if(hw_buf == NULL)
+    {
+        return;
+    }
+
+    if(au_end)
+    {
+        hw_buf->flags |= SX_NAL_FLAG_AU_END;
+    }
+
+    if(hw_buf->flags & SX_NAL_FLAG_AU_START)
+    {
+        sx_camera_hw_pace_wait(&f_cblk.pace);
+    }
+
+    // Every NAL unit of the access unit carries its release time.
+    hw_buf->pts = f_cblk.pace.pts;
+
+    sx_camera_hw_push(hw_buf);
+
+    f_cblk.pending = NULL;
+}
+
+
+// Close the assembled NAL unit. The one before it is queued now that
+// we know whether this one opens a new access unit.
+static void nal_close(
+    void
+    )
+{
+    sSX_CAMERA_HW_BUFFER   *hw_buf;
+    unsigned char           nal_type;
+
+
+    hw_buf = f_cblk.hw_buf;
+
+    if(f_cblk.truncated)
+    {
+        logger_log("(camera_hw_replay): NAL unit exceeds %d bytes, dropped.",
+                   SX_CAMERA_HW_NAL_LEN_MAX);
+
+        f_cblk.truncated = 0;
+
+        // Start over in a fresh buffer.
+        sx_camera_hw_release(hw_buf);
+
+        f_cblk.hw_buf = sx_camera_hw_buffer_alloc(REPLAY_NAL_SIZE_INIT);
+
+        return;
+    }
+
+    // Drop trailing zeros, they belong to the next start code.
+    hw_buf->nal_len -= sx_seg_trim_zeros(&hw_buf->seg);
+
+    if(hw_buf->nal_len == 0)
+    {
+        return;
+    }
+
+    hw_buf->flags = 0;
+
+    if(sx_nal_au_start(&f_cblk.au, hw_buf->seg.data, hw_buf->seg.len))
+    {
+        hw_buf->flags = SX_NAL_FLAG_AU_START;
+
+        f_cblk.au_count++;
+    }
+
+    pending_push(hw_buf->flags & SX_NAL_FLAG_AU_START);
+
+    // On a keyframe request, seek: drop whole access units, unpaced,
+    // until one opens with an SPS or IDR.
+    nal_type = hw_buf->seg.data[0] & 0x1F;
+
+    if((hw_buf->flags & SX_NAL_FLAG_AU_START) && sx_camera_hw_keyframe_pending())
+    {
+        f_cblk.seeking = 1;
+    }
+
+    if(f_cblk.seeking && ((nal_type == 0x07) || (nal_type == 0x05)))
+    {
+        // AUD or SEI before it went, it opens the access unit now.
+        hw_buf->flags |= SX_NAL_FLAG_AU_START;
+
+        f_cblk.seeking = 0;
+    }
+
+    if(f_cblk.seeking)
+    {
+        sx_camera_hw_release(hw_buf);
+
+        f_cblk.skip_count++;
+    }
+    else
+    {
+        f_cblk.pending = hw_buf;
+
+        f_cblk.nal_count++;
+    }
+
+    f_cblk.hw_buf = sx_camera_hw_buffer_alloc(REPLAY_NAL_SIZE_INIT);
+}
+
+
+// Append bytes to the NAL unit being assembled.
+static void nal_append(
+    const unsigned char    *data,
+    unsigned int            len
+    )
+{
+    sSX_CAMERA_HW_BUFFER   *hw_buf;
+
+
+    hw_buf = f_cblk.hw_buf;
+
+    if(hw_buf->nal_len + len > SX_CAMERA_HW_NAL_LEN_MAX)
+    {
+        f_cblk.truncated = 1;
+
+        len = SX_CAMERA_HW_NAL_LEN_MAX - hw_buf->nal_len;
+    }
+
+    sx_camera_hw_buffer_append(hw_buf, data, len);
+}
+
+
+// Split a chunk of Annex-B byte stream into NAL units.
+static void stream_parse(
+    unsigned char  *data,
+    unsigned int    len
+    )
+{
+    unsigned int    pos;
+    unsigned int    start_code;
+    unsigned int    i;
+
+
+    pos = 0;
+
+    // Start code split across the previous chunk.
+    if((f_cblk.zero_count >= 2) && (len >= 1) && (data[0] == 0x01))
+    {
+        pos = 1;
+    }
+    else if((f_cblk.zero_count >= 1) && (len >= 2) && (data[0] == 0x00) && (data[1] == 0x01))
+    {
+        pos = 2;
+    }
+
+    if(pos != 0)
+    {
+        if(f_cblk.in_nal)
+        {
+            nal_close();
+        }
+
+        f_cblk.in_nal = 1;
+    }
+
+    while(pos < len)
+    {
+        start_code = sx_nal_scan(&data[pos], &data[len]) - data;
+
+        // Anything before the first start code is leading garbage.
+        if(f_cblk.in_nal)
+        {
+            nal_append(&data[pos], start_code - pos);
+        }
+
+        if(start_code == len)
+        {
+            break;
+        }
+
+        if(f_cblk.in_nal)
+        {
+            nal_close();
+        }
+
+        f_cblk.in_nal   = 1;
+        pos             = start_code + 3;
+    }
+
+    // Zeros at the end may open a start code in the next chunk.
+    i = 0;
+    while((i < len) && (i < 2) && (data[len - 1 - i] == 0x00))
+    {
+        i++;
+    }
+
+    f_cblk.zero_count = (i == len) ? f_cblk.zero_count + i : i;
+}
+
+
+static void replay_thread(
+    void   *arg
+    )
+{
+    FILE           *file;
+    unsigned char  *chunk;
+    size_t          bytes_read;
+
+
+    chunk = malloc(REPLAY_READ_SIZE);
+
+    f_cblk.hw_buf = sx_camera_hw_buffer_alloc(REPLAY_NAL_SIZE_INIT);
+
+    sx_camera_hw_pace_init(&f_cblk.pace, f_cblk.config.fps);
+
+    do
+    {
+        // Opening a FIFO blocks until a writer shows up.
+        file = fopen(f_cblk.config.replay_path, "rb");
+        if(file == NULL)
+        {
+            logger_log("(camera_hw_replay): Unable to open %s",
+                       f_cblk.config.replay_path);
+            break;
+        }
+
+        logger_log("(camera_hw_replay): Replaying %s [fps = %d, loop = %d]",
+                   f_cblk.config.replay_path,
+                   f_cblk.config.fps,
+                   f_cblk.config.replay_loop);
+
+        while((bytes_read = fread(chunk, 1, REPLAY_READ_SIZE, file)) > 0)
+        {
+            stream_parse(chunk, bytes_read);
+        }
+
+        fclose(file);
+
+        // Flush the last NAL unit of the stream, it ends its access unit.
+        if(f_cblk.in_nal)
+        {
+            nal_close();
+        }
+
+        pending_push(1);
+
+        f_cblk.in_nal       = 0;
+        f_cblk.zero_count   = 0;
+
+        logger_log("(camera_hw_replay): End of stream [nal = %d, au = %d, skipped = %d]",
+                   f_cblk.nal_count,
+                   f_cblk.au_count,
+                   f_cblk.skip_count);
+
+    } while(f_cblk.config.replay_loop);
+
+    sx_camera_hw_release(f_cblk.hw_buf);
+    f_cblk.hw_buf = NULL;
+
+    free(chunk);
+}
+
+
+void sx_camera_hw_replay_open(
+    const sSX_CAMERA_HW_CONFIG *config
+    )
+{
+    assert(config->replay_path != NULL);
+
+    memset(&f_cblk, 0, sizeof(f_cblk));
+
+    f_cblk.config = *config;
+
+    pthread_create(&f_cblk.thread_id, NULL, (void *) &replay_thread, NULL);
+}
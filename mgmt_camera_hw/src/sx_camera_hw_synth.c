@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "logger.h"
+#include "sx_nal_scan.h"
+#include "sx_mgmt_camera_hw.h"
+#include "sx_camera_hw_source.h"
+
+#define SYNTH_PATTERN_SIZE      (128*1024)
+#define SYNTH_SEED              0x5eed
+
+
+// Synthetic source control block.
+typedef struct
+{
+    sSX_CAMERA_HW_CONFIG    config;         ///< Source configuration.
+    pthread_t               thread_id;      ///< Generator thread.
+    sSX_CAMERA_HW_PACE      pace;           ///< Frame playout clock.
+
+    unsigned int            seed;           ///< rand_r() state, fixed for repeatable runs.
+    unsigned char          *pattern;        ///< Slice payload source, no zero bytes.
+
+    unsigned int            p_frame_size;   ///< Mean P frame size (bytes).
+    unsigned int            idr_frame_size; ///< Mean IDR frame size (bytes).
+
+    unsigned int            gop_frame;      ///< Frame index within the GOP, 0 = IDR.
+    unsigned int            frame_count;    ///< Frames generated.
+    unsigned long long      byte_count;     ///< Payload bytes generated.
+    unsigned int            clamp_count;    ///< Slices clamped to max NAL length.
+
+} sCAMERA_HW_SYNTH_CBLK;
+
+
+// Parameter sets of the 720p stream advertised in the SDP.
+static const unsigned char f_sps[] =
+{
+    0x27, 0x64, 0x00, 0x1e, 0xac, 0x2b, 0x40, 0x50,
+    0x17, 0xfc, 0xb0, 0x0f, 0x12, 0x26, 0xa0
+};
+
+static const unsigned char f_pps[] =
+{
+    0x28, 0xee, 0x02, 0x5c, 0xb0
+};
+
+
+// Synthetic source control block.
+static sCAMERA_HW_SYNTH_CBLK f_cblk;
+
+
+// Queue a NAL unit built from a header and pattern payload.
+static void nal_queue(
+    const unsigned char    *hdr,
+    unsigned int            hdr_len,
+    unsigned int            nal_len,
+    unsigned char           flags
+    )
+{
+    sSX_CAMERA_HW_BUFFER   *hw_buf;
+    unsigned int            offset;
+    unsigned int            len;
+
+
+    if(nal_len > SX_CAMERA_HW_NAL_LEN_MAX)
+    {
+        nal_len = SX_CAMERA_HW_NAL_LEN_MAX;
+
+        f_cblk.clamp_count++;
+    }
+
+    if(nal_len < hdr_len)
+    {
+        nal_len = hdr_len;
+    }
+
+    hw_buf = sx_camera_hw_buffer_alloc(nal_len);
+
+    sx_camera_hw_buffer_append(hw_buf, hdr, hdr_len);
+
+    // Payload from random windows of the pattern.
+    while(hw_buf->nal_len < nal_len)
+    {
+        len = nal_len - hw_buf->nal_len;
+        if(len > SYNTH_PATTERN_SIZE)
+        {
+            len = SYNTH_PATTERN_SIZE;
+        }
+
+        offset = rand_r(&f_cblk.seed) % (SYNTH_PATTERN_SIZE - len + 1);
+
+        sx_camera_hw_buffer_append(hw_buf, &f_cblk.pattern[offset], len);
+    }
+    hw_buf->flags   = flags;
+    hw_buf->pts     = f_cblk.pace.pts;
+
+    f_cblk.byte_count += nal_len;
+
+    sx_camera_hw_push(hw_buf);
+}
+
+
+// Frame size with +/- jitter percent spread.
+static unsigned int frame_size_get(
+    unsigned int    mean
+    )
+{
+    int spread;
+
+
+    if(f_cblk.config.synth_jitter == 0)
+    {
+        return mean;
+    }
+
+    spread = (int) (mean * f_cblk.config.synth_jitter / 100);
+
+    return mean - spread + rand_r(&f_cblk.seed) % (2 * spread + 1);
+}
+
+
+// Generate one access unit. A pending keyframe request restarts the GOP.
+static void frame_generate(
+    void
+    )
+{
+    unsigned char   idr;
+    unsigned char   flags;
+    unsigned char   hdr[2];
+    unsigned int    frame_size;
+    unsigned int    slice_size;
+    unsigned int    slice;
+
+
+    idr = (f_cblk.gop_frame == 0) || sx_camera_hw_keyframe_pending();
+    if(idr)
+    {
+        f_cblk.gop_frame = 0;
+    }
+
+    f_cblk.gop_frame = (f_cblk.gop_frame + 1) % f_cblk.config.synth_gop;
+
+    flags = SX_NAL_FLAG_AU_START;
+
+    if(idr)
+    {
+        nal_queue(f_sps, sizeof(f_sps), sizeof(f_sps), flags);
+        nal_queue(f_pps, sizeof(f_pps), sizeof(f_pps), 0);
+
+        flags = 0;
+    }
+
+    frame_size = frame_size_get(idr ? f_cblk.idr_frame_size : f_cblk.p_frame_size);
+    slice_size = frame_size / f_cblk.config.slices;
+
+    for(slice = 0; slice < f_cblk.config.slices; slice++)
+    {
+        // nal_ref_idc = 3 for IDR, 2 for P.
+        hdr[0] = idr ? 0x65 : 0x41;
+
+        // first_mb_in_slice == 0 ('1') on the first slice only, then
+        // slice_type (7 = I, 5 = P) as ue(v).
+        if(slice == 0)
+        {
+            hdr[1] = idr ? 0x88 : 0x9a;
+        }
+        else
+        {
+            hdr[1] = idr ? 0x42 : 0x46;
+        }
+
+        if(slice == f_cblk.config.slices - 1)
+        {
+            flags |= SX_NAL_FLAG_AU_END;
+        }
+
+        nal_queue(hdr, sizeof(hdr), slice_size, flags);
+
+        flags = 0;
+    }
+
+    f_cblk.frame_count++;
+}
+
+
+static void synth_thread(
+    void   *arg
+    )
+{
+    unsigned int    fps;
+
+
+    fps = (f_cblk.config.fps != 0) ? f_cblk.config.fps : SX_CAMERA_HW_FPS_NOMINAL;
+
+    sx_camera_hw_pace_init(&f_cblk.pace, f_cblk.config.fps);
+
+    while(1)
+    {
+        sx_camera_hw_pace_wait(&f_cblk.pace);
+
+        frame_generate();
+
+        if((f_cblk.frame_count % (fps * 10)) == 0)
+        {
+            logger_log("(camera_hw_synth): frames = %d, bytes = %llu, clamped = %d",
+                       f_cblk.frame_count,
+                       f_cblk.byte_count,
+                       f_cblk.clamp_count);
+        }
+    }
+}
+
+
+void sx_camera_hw_synth_open(
+    const sSX_CAMERA_HW_CONFIG *config
+    )
+{
+    unsigned int        i;
+    unsigned int        fps;
+    unsigned long long  gop_bytes;
+
+
+    assert(config->synth_gop > 0);
+    assert(config->slices > 0);
+    assert(config->synth_idr_ratio > 0);
+    assert(config->synth_jitter <= 100);
+
+    memset(&f_cblk, 0, sizeof(f_cblk));
+
+    f_cblk.config       = *config;
+    f_cblk.seed         = SYNTH_SEED;
+
+    // Non-zero bytes can never form a start code or need emulation prevention.
+    f_cblk.pattern = malloc(SYNTH_PATTERN_SIZE);
+    for(i = 0; i < SYNTH_PATTERN_SIZE; i++)
+    {
+        f_cblk.pattern[i] = 1 + rand_r(&f_cblk.seed) % 255;
+    }
+
+    // Split the GOP byte budget so one IDR costs idr_ratio P frames.
+    fps         = (config->fps != 0) ? config->fps : SX_CAMERA_HW_FPS_NOMINAL;
+    gop_bytes   = (unsigned long long) config->synth_bitrate / 8 * config->synth_gop / fps;
+
+    f_cblk.p_frame_size     = gop_bytes / (config->synth_idr_ratio + config->synth_gop - 1);
+    f_cblk.idr_frame_size   = f_cblk.p_frame_size * config->synth_idr_ratio;
+
+    logger_log("(camera_hw_synth): bitrate = %d, fps = %d, gop = %d, idr = %d bytes, p = %d bytes, slices = %d",
+               config->synth_bitrate,
+               config->fps,
+               config->synth_gop,
+               f_cblk.idr_frame_size,
+               f_cblk.p_frame_size,
+               config->slices);
+
+    pthread_create(&f_cblk.thread_id, NULL, (void *) &synth_thread, NULL);
+}
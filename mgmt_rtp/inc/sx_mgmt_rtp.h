@@ -1,6 +1,37 @@
 #ifndef _MGMT_RTP_H_
 #define _MGMT_RTP_H_
 
+// Server RTP port advertised in SETUP, RTCP is the port above it.
+#define SX_MGMT_RTP_SERVER_PORT     62000
+
+// Send worker threads at most.
+#define SX_MGMT_RTP_WORKERS_MAX     8
+
+// Default pace window, a frame interval at 30 fps.
+#define SX_MGMT_RTP_PACE_WINDOW_US  33333
+
+// Default output budget of an interleaved (RTP over RTSP) session.
+#define SX_MGMT_RTP_TCP_BUDGET      (512 * 1024)
+
+
+typedef struct
+{
+    unsigned int    workers;        ///< Send worker threads, 0 = send from the RTP manager thread.
+    unsigned int    pace_window_us; ///< Spread each NAL unit's packets over this, 0 = send at once.
+    unsigned int    session_rate_max;   ///< Per session send rate cap (bits/s), 0 = none.
+    unsigned char   gso;            ///< Send packet runs with UDP GSO where the kernel has it.
+    unsigned int    tcp_budget;     ///< Bytes an interleaved session may have queued, past it NAL units are skipped to the next key unit. 0 = none.
+
+} sSX_MGMT_RTP_CONFIG;
+
+
+extern void sx_mgmt_rtp_config_get(
+    sSX_MGMT_RTP_CONFIG        *config
+    );
+
+extern void sx_mgmt_rtp_config_set(
+    const sSX_MGMT_RTP_CONFIG  *config
+    );
 
 
 extern void sx_mgmt_rtp_init(
@@ -21,4 +52,30 @@ extern void sx_mgmt_rtp_reset(
     unsigned int    id
     );
 
+extern void sx_mgmt_rtp_service(
+    void
+    );
+
+extern void sx_mgmt_rtp_interleave_open(
+    unsigned int    id,
+    int             tcp_sock,
+    unsigned char   channel
+    );
+
+extern unsigned char sx_mgmt_rtp_interleave_write(
+    unsigned int    id,
+    const char     *data,
+    unsigned int    len
+    );
+
+extern void sx_mgmt_rtp_interleave_close(
+    unsigned int    id
+    );
+
+extern void sx_mgmt_rtp_rtcp_input(
+    unsigned int            ip,
+    const unsigned char    *pkt,
+    unsigned int            len
+    );
+
 #endif // _MGMT_RTP_H_
@@ -1,19 +1,72 @@
+#define _GNU_SOURCE
+
 #include "stdio.h" 
 #include "stdlib.h" 
 #include "string.h" 
+#include "unistd.h"
+#include "sched.h"
+#include "errno.h"
 #include <sys/socket.h>
 #include <netinet/in.h> 
+#include <netinet/udp.h>
 #include <netdb.h> 
 #include "pthread.h"
 #include "fcntl.h"
-#include "mqueue.h"
 #include "assert.h"
 
+#include "sx_mailbox.h"
+#include "sx_reactor.h"
+#include "sx_timer.h"
+#include "sx_uring.h"
+#include "sx_slab.h"
+#include "sx_clock.h"
 #include "sx_mgmt_rtp.h"
 #include "sx_mgmt_video.h"
 #include "nal_to_rtp.h"
+#include "sx_nal_scan.h"
+
+// Messages per mailbox lane, SERVICE is coalesced so this covers sessions.
+#define MGMT_RTP_MAILBOX_LANE_SIZE  64
+
+// NAL units posted to a send worker ahead of it.
+#define MGMT_RTP_WORKER_LANE_SIZE   64
+
+#define MGMT_RTP_SESSION_NUM        32
+
+// Pacing. NAL units queued per session, send credit a session can
+// save up, and the retry delay after a full socket buffer.
+#define MGMT_RTP_PACE_QUEUE_LEN     256
+#define MGMT_RTP_PACE_BURST         (4 * 1500)
+#define MGMT_RTP_PACE_RETRY_US      1000
+
+// Packets sent per sendmmsg() (or io_uring submission) at most.
+#define MGMT_RTP_BATCH_LEN          64
+
+// UDP GSO, a run of one session's packets is sent as one buffer the
+// kernel splits. Segments and bytes per buffer at most.
+#if !defined(UDP_SEGMENT)
+#define UDP_SEGMENT                 103
+#endif
+#define MGMT_RTP_GSO_SEGS_MAX       64
+#define MGMT_RTP_GSO_BYTES_MAX      63000
+
+#define MGMT_RTP_RTCP_PKT_SIZE_MAX  1500
 
-#define MGMT_RTP_MSG_QUEUE  "/mgmt_rtp_msg_queue"
+// RTP over the RTSP connection (RFC 2326 10.12), each packet behind a
+// '$', channel, length prefix. Packets per sendmsg() at most, and bytes
+// held for the connection: a packet's unsent tail, responses behind it.
+#define MGMT_RTP_TCP_PREFIX_LEN     4
+#define MGMT_RTP_TCP_PKTS           16
+#define MGMT_RTP_TCP_OUT_SIZE       8192
+
+// NAL units sent per SERVICE message before control messages get a turn.
+#define MGMT_RTP_SERVICE_BATCH      64
+
+// RTCP keyframe requests.
+#define RTCP_PT_FIR_LEGACY          192     ///< Full intra request (RFC 2032).
+#define RTCP_PT_PSFB                206     ///< Payload-specific feedback (RFC 4585).
+#define RTCP_PSFB_FMT_PLI           1       ///< Picture loss indication.
+#define RTCP_PSFB_FMT_FIR           4       ///< Full intra request (RFC 5104).
 
 typedef enum
 {
@@ -64,376 +117,2400 @@ typedef struct
 } sMGMT_RTP_MSG;
 
 
+// A NAL unit and its packets, shared read-only by the sessions sending it.
+typedef struct
+{
+    sMGMT_VIDEO_NAL_UNIT   *nal_unit;       ///< Unit being sent.
+    sRTP_PKT_DESC          *pkts;           ///< Its packets, without session headers, payload in place.
+    unsigned int            bytes;          ///< Packet bytes, all packets.
+    int                     ref_count;      ///< Worker posts and pace queue entries.
+
+} sMGMT_RTP_FANOUT;
+
+
+// NAL unit waiting in a session's pace queue.
+typedef struct
+{
+    sMGMT_RTP_FANOUT       *fanout;         ///< Packets, one reference held.
+    unsigned int            timestamp;      ///< Session RTP timestamp.
+
+} sMGMT_RTP_PACED;
+
+
+// RTSP connection an interleaved session's packets go on. Its pacing
+// thread and the RTSP manager's responses write to it, under mutex, so
+// a response never lands inside a packet.
+typedef struct
+{
+    pthread_mutex_t     mutex;
+    int                 sock;               ///< Own duplicate of the connection, -1 = closed.
+    unsigned char       channel;            ///< RTP channel, RTCP is the one above.
+
+    char                out[MGMT_RTP_TCP_OUT_SIZE];     ///< Written ahead of any packet.
+    unsigned int        out_head;           ///< First unwritten byte of out.
+    unsigned int        out_len;            ///< Bytes in out from out_head.
+
+    unsigned char       prefixes[MGMT_RTP_TCP_PKTS][MGMT_RTP_TCP_PREFIX_LEN];
+    sRTP_HEADER         hdrs[MGMT_RTP_TCP_PKTS];        ///< Session headers of a write.
+    struct iovec        iov[(1 + RTP_DESC_IOV_MAX) * MGMT_RTP_TCP_PKTS];
+    unsigned int        iov_first[MGMT_RTP_TCP_PKTS + 1];   ///< First iovec of each packet, and the end.
+
+    unsigned int        write_count;        ///< sendmsg() calls.
+    unsigned int        short_count;        ///< Writes that ended inside a packet.
+
+} sMGMT_RTP_CONN;
+
+
 typedef struct
 {
     unsigned char       in_use; 
     struct sockaddr_in  peer_addr;
+    sMGMT_RTP_CONN     *conn;               ///< Interleaved on this connection, NULL = UDP to peer_addr.
     unsigned char       sps_sent; 
     unsigned char       pps_sent; 
     unsigned char       idr_observed; 
 
     void               *nal_to_rtp_instance;
 
+    sMGMT_RTP_PACED     paced[MGMT_RTP_PACE_QUEUE_LEN];    ///< NAL units to send, in order.
+    unsigned int        paced_head;         ///< Oldest queued.
+    unsigned int        paced_count;        ///< Queued.
+    const sRTP_PKT_DESC*paced_pkt;          ///< Next packet of the oldest.
+    unsigned int        backlog;            ///< Bytes queued.
+
+    unsigned int        batch_index;        ///< Queue entry of batch_pkt, from paced_head.
+    const sRTP_PKT_DESC*batch_pkt;          ///< Next packet to batch, paced_pkt or later.
+    unsigned int        batched;            ///< Packets in the batch, not sent yet.
+
+    unsigned long long  rate;               ///< Pacing rate (bytes/s), 0 = unpaced.
+    long long           tokens;             ///< Send credit (bytes), a packet may overdraw it.
+    unsigned long long  tokens_us;          ///< When tokens was last topped up.
+    unsigned long long  retry_us;           ///< Socket buffer was full, retry then.
+    sSX_TIMER           pace_timer;         ///< Next send, on the pacing thread's wheel.
+    struct sMGMT_RTP_BATCH *batch;          ///< Pacing thread's send batch.
+
+    unsigned int        pkt_count;          ///< Packets sent.
+    unsigned int        eagain_count;       ///< Sends deferred on a full socket buffer.
+    unsigned int        error_count;        ///< Packets lost to other send errors.
+    unsigned int        drop_count;         ///< NAL units dropped on a full pace queue.
+    unsigned int        skip_count;         ///< NAL units skipped over the output budget.
+
 } sSESSION; 
 
 
+// Packets collected across sessions and sent with one sendmmsg(), or
+// one io_uring submission. A session's packets count as sent once the
+// flush says so. With GSO,
+// consecutive packets of a session go in one message while they are
+// the size of its first, the last may be shorter.
+typedef struct sMGMT_RTP_BATCH
+{
+    int                 sock;               ///< Socket of the owning thread.
+    unsigned char       gso;                ///< Messages may carry several packets.
+    SX_URING            ring;               ///< Sends through io_uring, sock is fixed file 0. NULL = sendmmsg().
+
+    struct mmsghdr      msgs[MGMT_RTP_BATCH_LEN];
+    union
+    {
+        char            buf[CMSG_SPACE(sizeof(unsigned short))];
+        struct cmsghdr  align;
+    }                   ctrl[MGMT_RTP_BATCH_LEN];       ///< UDP_SEGMENT of each message.
+    unsigned int        msg_first[MGMT_RTP_BATCH_LEN];  ///< First packet of each message.
+    unsigned int        msg_bytes[MGMT_RTP_BATCH_LEN];  ///< Bytes in each message.
+    unsigned int        msg_count;          ///< Messages collected.
+
+    struct iovec        iov[RTP_DESC_IOV_MAX * MGMT_RTP_BATCH_LEN];  ///< Each packet's, in order.
+    unsigned int        iov_count;          ///< iovecs used.
+    sRTP_HEADER         hdrs[MGMT_RTP_BATCH_LEN];       ///< Session headers.
+    sSESSION           *sessions[MGMT_RTP_BATCH_LEN];   ///< Sender of each packet.
+    const sRTP_PKT_DESC*pkts[MGMT_RTP_BATCH_LEN];       ///< Packet sent.
+    unsigned int        count;              ///< Packets collected.
+
+    unsigned int        call_count;         ///< sendmmsg() calls or io_uring submissions.
+    unsigned int        pkt_count;          ///< Packets sent or lost.
+    unsigned int        gso_count;          ///< Messages of several packets sent.
+    unsigned int        defer_count;        ///< Packets put back on a full socket buffer.
+
+} sMGMT_RTP_BATCH;
+
+
+typedef struct
+{
+    sMGMT_RTP_FANOUT       *fanout;
+
+} sMGMT_RTP_WORKER_MSG;
+
+
+// Send worker, sends to a shard of the sessions.
+typedef struct
+{
+    pthread_t           thread_id;
+    unsigned int        index;              ///< Worker number, picks the core.
+    int                 sock;               ///< Own socket on the server RTP port.
+    SX_MAILBOX          mailbox;            ///< NAL units to send.
+    pthread_mutex_t     mutex;              ///< Held while it touches its sessions.
+    SX_TIMER_WHEEL      wheel;              ///< Pace timers of its sessions.
+    sMGMT_RTP_BATCH     batch;              ///< Sends to its sessions.
+
+    unsigned char       session_ids[MGMT_RTP_SESSION_NUM];  ///< Shard, set while the worker is idle.
+    unsigned int        session_count;      ///< Sessions in the shard.
+
+    unsigned int        posted;             ///< NAL units posted, RTP thread only.
+    unsigned int        sent;               ///< NAL units sent, written by the worker.
+
+} sMGMT_RTP_WORKER;
+
+
 // RTP manager control block.
 typedef struct
 {
     pthread_t           rtp_thread;
-    pthread_t           timer_thread;
+    pthread_t           rtcp_thread;        ///< RTCP receiver.
     int                 rtp_sock;
-    mqd_t               msg_queue;
+    int                 rtcp_sock;          ///< Bound to the advertised server RTCP port.
+    SX_MAILBOX          mailbox;            ///< Control and service messages.
     unsigned int        ip;
     unsigned short      port;
     struct sockaddr_in  peer_addr;
     eMGMT_RTP_STATE     state;
-    sSESSION            sessions[32]; 
+    sSESSION            sessions[MGMT_RTP_SESSION_NUM]; 
+    unsigned int        session_count;      ///< Sessions in use.
+    volatile int        service_pending;    ///< SERVICE message in flight.
+    unsigned int        rtcp_keyframe_count;///< PLI/FIR received.
+    SX_TIMER_WHEEL      wheel;              ///< Pace timers without workers.
+    sMGMT_RTP_BATCH     batch;              ///< Sends without workers.
+
+    sSX_MGMT_RTP_CONFIG config;             ///< Worker and pacing configuration.
+    sMGMT_RTP_WORKER    workers[SX_MGMT_RTP_WORKERS_MAX];   ///< Send workers.
 
 } sMGMT_RTP_CBLK;
 
 
 // Control block. 
-static sMGMT_RTP_CBLK f_cblk;
+static sMGMT_RTP_CBLK f_cblk = 
+{
+    .config = 
+    {
+        .pace_window_us = SX_MGMT_RTP_PACE_WINDOW_US,
+        .gso            = 1,
+        .tcp_budget     = SX_MGMT_RTP_TCP_BUDGET,
+    },
+};
+
+
+// Interleaved connections by RTSP session id. Kept out of the control
+// block, which is initialized data.
+static sMGMT_RTP_CONN f_conns[MGMT_RTP_SESSION_NUM];
+
+
+static void session_dequeue(
+    sSESSION   *session
+    );
+
+
+// A batched packet went out (or was lost), move the session past it.
+static void batch_pkt_commit(
+    sSESSION               *session,
+    const sRTP_PKT_DESC    *pkt
+    )
+{
+    assert(pkt == session->paced_pkt);
+
+    session->batched--;
+    session->pkt_count++;
+    session->backlog -= pkt->rtp_pkt_len;
+
+    session->paced_pkt = pkt->next;
+    if(session->paced_pkt == NULL)
+    {
+        session_dequeue(session);
+
+        // The batch cursor is relative to the head.
+        session->batch_index--;
+    }
+}
 
 
-//  Sends NAL unit as RTP packets.
-static void rtp_send(
-    int             sock, 
-    sSESSION       *session, 
-    unsigned char  *nal_unit, 
-    unsigned int    nal_unit_len
+// --------------------------------------------------------
+// batch_pkt_defer
+//      The socket buffer is full, put a batched packet back. Its
+//      session resends from its first unsent packet after the
+//      retry delay, with the same sequence numbers.
+//
+static void batch_pkt_defer(
+    sMGMT_RTP_BATCH        *batch,
+    sSESSION               *session,
+    const sRTP_PKT_DESC    *pkt,
+    unsigned long long      retry_us
     )
 {
-    sRTP_PKT_NODE  *head;
-    sRTP_PKT_NODE  *temp;
+    batch->defer_count++;
 
+    session->batched--;
 
-    // Get the converted RTP chain.
-    head = sx_nal_to_rtp_util_get(session->nal_to_rtp_instance,
-                                  nal_unit,
-                                  nal_unit_len);
-    temp = head; 
+    sx_nal_to_rtp_util_sequence_rewind(session->nal_to_rtp_instance, 1);
 
-    logger_log("Peer IP: 0x%x", session->peer_addr);
+    if(session->rate != 0)
+    {
+        session->tokens += pkt->rtp_pkt_len;
+    }
 
-    do
+    if(session->retry_us == retry_us)
     {
-        // Send the packet.
-        int rv = sendto(sock,
-                        &temp->rtp_pkt,
-                        temp->rtp_pkt_len,
-                        0,
-                        (struct sockaddr *) &session->peer_addr,
-                        sizeof(struct sockaddr));
-        assert(rv == temp->rtp_pkt_len);
+        return;
+    }
 
-        temp = temp->next; 
+    // First of its packets put back.
+    session->eagain_count++;
 
-    } while (temp); 
+    session->retry_us       = retry_us;
+    session->batch_index    = 0;
+    session->batch_pkt      = session->paced_pkt;
 
-    // Free the NAL unit.
-    sx_nal_to_rtp_util_free(head); 
+    sx_timer_arm(&session->pace_timer, retry_us);
 }
 
 
-static void idle_state_handler(
-    sMGMT_RTP_MSG  *msg
+// Packets of a message.
+static unsigned int batch_msg_pkts(
+    const sMGMT_RTP_BATCH  *batch,
+    unsigned int            msg
     )
 {
-    
+    unsigned int    end;
+
+
+    end = (msg + 1 < batch->msg_count) ? batch->msg_first[msg + 1] : batch->count;
+
+    return end - batch->msg_first[msg];
 }
 
 
-static void activate_handler(
-    sMGMT_RTP_MSG  *msg
+// --------------------------------------------------------
+// batch_ring_send
+//      sendmmsg() through the ring. The messages go as linked SQEs,
+//      a failure cancels the ones behind it, so what went out is a
+//      prefix as with sendmmsg(). All complete before the submit
+//      returns, non-blocking UDP sends don't wait. If the ring
+//      itself fails the batch goes back to sendmmsg() for good,
+//      from the first message the ring did not send.
+//
+//      Returns messages sent, or -1 with errno set by the first
+//      failure.
+//
+static int batch_ring_send(
+    sMGMT_RTP_BATCH    *batch,
+    unsigned int        first
     )
 {
-    sSESSION *session;
+    sSX_URING_CQE   cqes[MGMT_RTP_BATCH_LEN];
+    int             res[MGMT_RTP_BATCH_LEN];
+    unsigned int    count;
+    unsigned int    submitted;
+    unsigned int    taken;
+    unsigned int    reaped;
+    unsigned int    i;
+    unsigned char   queued;
+    int             rv;
 
 
-    logger_log("MGMT_RTP: ACTIVATE received [id = %d]",
-               msg->event_data.activate.id);
+    count = batch->msg_count - first;
 
+    for(i = first; i < batch->msg_count; i++)
+    {
+        queued = sx_uring_sendmsg_queue(batch->ring, 0, &batch->msgs[i].msg_hdr, i + 1 < batch->msg_count, i);
+        assert(queued);
+    }
 
-    session = &f_cblk.sessions[msg->event_data.activate.id];
+    rv = sx_uring_submit(batch->ring, count);
 
-    session->in_use                     = 1;
-    session->peer_addr.sin_family       = AF_INET;
-    session->peer_addr.sin_addr.s_addr  = msg->event_data.activate.ip;
-    session->peer_addr.sin_port         = htons(msg->event_data.activate.port);
-    bzero(&(session->peer_addr.sin_zero), 8);
+    submitted = (rv > 0) ? rv : 0;
 
-    session->idr_observed   = 0;
-    session->pps_sent       = 0;
-    session->sps_sent       = 0;
+    // The kernel took these, they went out or failed, never resend them.
+    for(reaped = 0; reaped < submitted; reaped += taken)
+    {
+        taken = sx_uring_reap(batch->ring, cqes, submitted - reaped);
+        assert(taken != 0);
 
-    session->nal_to_rtp_instance = sx_nal_to_rtp_util_create();
+        for(i = 0; i < taken; i++)
+        {
+            res[cqes[i].user_data - first] = cqes[i].res;
+        }
+    }
 
-    f_cblk.state = MGMT_RTP_STATE_ACTIVE;
-}
+    for(i = 0; i < submitted; i++)
+    {
+        if(res[i] < 0)
+        {
+            break;
+        }
+    }
 
+    if(submitted < count)
+    {
+        // The ring is broken, not the sends. Those it didn't take, or
+        // that a broken link cancelled, go with sendmmsg().
+        logger_log("(mgmt_rtp): io_uring took %d of %d sends, back to sendmmsg [errno = %d]", submitted, count, errno);
 
-static void reset_handler(
-    sMGMT_RTP_MSG  *msg
-    )
-{
-    logger_log("MGMT_RTP: RESET received [id = %d]",
-            msg->event_data.reset.id);
+        sx_uring_destroy(batch->ring);
 
-    sSESSION *session = &f_cblk.sessions[msg->event_data.reset.id];
+        batch->ring = NULL;
 
-    session->in_use = 0;
+        if(i > 0)
+        {
+            return i;
+        }
 
-    sx_nal_to_rtp_util_destroy(session->nal_to_rtp_instance);
+        return sendmmsg(batch->sock, &batch->msgs[first], count, 0);
+    }
 
-    session->nal_to_rtp_instance = NULL;
+    if(i == 0)
+    {
+        errno = -res[0];
+
+        return -1;
+    }
+
+    return i;
 }
 
 
-static void service_handler(
-    sMGMT_RTP_MSG  *msg
+// --------------------------------------------------------
+// batch_flush
+//      Send the batched messages, as many per sendmmsg() as the
+//      socket takes. A message failing with an error other than
+//      a full buffer is lost, the receiver recovers as from any
+//      network loss. If the kernel turns down a GSO message, GSO
+//      is switched off and the rest resent without.
+//
+static void batch_flush(
+    sMGMT_RTP_BATCH    *batch
     )
 {
-    unsigned int            i;
-    sMGMT_VIDEO_NAL_UNIT   *nal_unit;
-    sMGMT_VIDEO_NAL_UNIT   *sps_nal_unit;
-    sMGMT_VIDEO_NAL_UNIT   *pps_nal_unit;
-    sMGMT_VIDEO_NAL_UNIT   *nal_unit_to_send;
+    unsigned long long  retry_us;
+    unsigned int        sent;
+    unsigned int        pkts;
+    unsigned int        i;
+    unsigned int        j;
+    int                 rv;
 
 
-    nal_unit = sx_mgmt_video_get_nal_unit();
+    sent = 0;
 
-    for(i = 0; i < 32; i++)
+    while(sent < batch->msg_count)
     {
-        sSESSION *session = &f_cblk.sessions[i];
+        if(batch->ring != NULL)
+        {
+            rv = batch_ring_send(batch, sent);
+        }
+        else
+        {
+            rv = sendmmsg(batch->sock, &batch->msgs[sent], batch->msg_count - sent, 0);
+        }
 
-        if(session->in_use)
+        batch->call_count++;
+
+        if(rv > 0)
         {
-            while(1)
+            for(i = sent; i < sent + rv; i++)
             {
-                if(!session->sps_sent)
+                pkts = batch_msg_pkts(batch, i);
+
+                for(j = batch->msg_first[i]; j < batch->msg_first[i] + pkts; j++)
                 {
-                    logger_log("Get SPS unit");
+                    batch_pkt_commit(batch->sessions[j], batch->pkts[j]);
+                }
 
-                    // Send SPS second.
-                    sps_nal_unit = sx_mgmt_video_sps_get();
-                    if(sps_nal_unit == NULL)
-                    {
-                        logger_log("mgmt_video_get_sps_nal_unit() returned NULL!");
-                        break;
-                    }
+                batch->pkt_count += pkts;
+                batch->gso_count += (pkts > 1);
+            }
 
-                    logger_log("SPS unit len %d", sps_nal_unit->nal_unit_len);
+            sent += rv;
 
-                    nal_unit_to_send = sps_nal_unit;
+            continue;
+        }
 
-                    session->sps_sent = 1;
-                }
-                else if(!session->pps_sent)
-                {
-                    logger_log("Get PPS unit");
+        if((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == ENOBUFS))
+        {
+            break;
+        }
 
-                    // Send PPS first.
-                    pps_nal_unit = sx_mgmt_video_pps_get();
-                    if(pps_nal_unit == NULL)
-                    {
-                        logger_log("mgmt_video_get_pps_nal_unit() returned NULL!");
-                        break;
-                    }
+        if(errno == EINTR)
+        {
+            continue;
+        }
 
-                    nal_unit_to_send = pps_nal_unit;
+        pkts = batch_msg_pkts(batch, sent);
 
-                    session->pps_sent = 1;
-                }
-                else
-                {
-                    // Send NAL units.
-
-                    if(nal_unit == NULL)
-                    {
-                        // Out of NAL units. Done.
-                        break;
-                    }
-
-                    if(!session->idr_observed)
-                    {
-                        // Start with key units.
-                        if(!sx_mgmt_video_is_key_frame(nal_unit))
-                        {
-                            break;
-                        }
-
-                        session->idr_observed = 1;
-                    }
-
-                    nal_unit_to_send = nal_unit;
-                }
+        if(pkts > 1)
+        {
+            logger_log("(mgmt_rtp): UDP GSO send failed, disabled [errno = %d]", errno);
 
-                // Send RTP.
-                rtp_send(f_cblk.rtp_sock,
-                        session,
-                        nal_unit_to_send->nal_unit,
-                        nal_unit_to_send->nal_unit_len);
+            batch->gso = 0;
 
-                break;
-            }
+            break;
         }
+
+        // The first unsent packet failed.
+        batch->sessions[batch->msg_first[sent]]->error_count++;
+
+        batch_pkt_commit(batch->sessions[batch->msg_first[sent]], batch->pkts[batch->msg_first[sent]]);
+
+        sent++;
+        batch->pkt_count++;
     }
 
-    if(nal_unit != NULL)
+    if(sent < batch->msg_count)
     {
-        // Free NAL unit.
-        sx_mgmt_video_free_nal_unit(nal_unit);
+        retry_us = sx_clock_mono_us() + MGMT_RTP_PACE_RETRY_US;
+
+        for(i = batch->msg_first[sent]; i < batch->count; i++)
+        {
+            batch_pkt_defer(batch, batch->sessions[i], batch->pkts[i], retry_us);
+        }
     }
+
+    batch->count        = 0;
+    batch->msg_count    = 0;
+    batch->iov_count    = 0;
 }
 
 
-static void rtp_thread(
-    void * arg
+// Reactor round or thread loop done.
+static void batch_flush_cback(
+    void   *arg
     )
 {
-    sMGMT_RTP_MSG           msg;
-    unsigned int            bytes_read;
+    batch_flush(arg);
+}
 
 
+// Can the packet go as another segment of the last message?
+static unsigned char batch_msg_extends(
+    const sMGMT_RTP_BATCH  *batch,
+    const sSESSION         *session,
+    unsigned int            len
+    )
+{
+    unsigned int    msg;
+    unsigned int    first;
+    unsigned int    last;
+    unsigned int    seg_len;
 
-    while(1)
-    {
-        bytes_read = mq_receive(f_cblk.msg_queue,
-                                (char *) &msg,
-                                sizeof(msg),
-                                NULL);
-        assert(bytes_read > 0);
 
-        switch(msg.event)
-        {
-            case MGMT_RTP_EVENT_ACTIVATE:
-            {
-                activate_handler(&msg);
-                break;
-            }
-            case MGMT_RTP_EVENT_RESET:
-            {
-                reset_handler(&msg);
-                break; 
-            }
-            case MGMT_RTP_EVENT_SERVICE:
-            {
-                service_handler(&msg);
-                break; 
-            }
-            default:
-            {
-                assert(0);
-            }
-        }
+    if(!batch->gso || (batch->msg_count == 0))
+    {
+        return 0;
     }
+
+    msg     = batch->msg_count - 1;
+    first   = batch->msg_first[msg];
+    last    = batch->count - 1;
+    seg_len = batch->pkts[first]->rtp_pkt_len;
+
+    return (batch->sessions[first] == session)
+           && (batch->pkts[last]->rtp_pkt_len == seg_len)
+           && (len <= seg_len)
+           && (batch->count - first < MGMT_RTP_GSO_SEGS_MAX)
+           && (batch->msg_bytes[msg] + len <= MGMT_RTP_GSO_BYTES_MAX);
 }
 
 
-static void timer_thread(
+// Set a message of several packets to be split at its first's size.
+static void batch_msg_gso_set(
+    sMGMT_RTP_BATCH    *batch,
+    unsigned int        msg
     )
 {
-    sMGMT_RTP_MSG   msg;
+    struct msghdr  *hdr;
+    struct cmsghdr *cmsg;
+    unsigned short  seg_len;
 
 
-    while (1)
+    hdr = &batch->msgs[msg].msg_hdr;
+
+    if(hdr->msg_controllen != 0)
     {
-        // Construct message.
-        msg.event = MGMT_RTP_EVENT_SERVICE;
+        return;
+    }
 
-        // Queue message.
-        mq_send(f_cblk.msg_queue,
-                (char *) &msg,
-                sizeof(sMGMT_RTP_MSG),
-                0);
+    hdr->msg_control    = batch->ctrl[msg].buf;
+    hdr->msg_controllen = sizeof(batch->ctrl[msg].buf);
 
-        // 30 fps
-        usleep(5*1000);
-    }
+    seg_len = batch->pkts[batch->msg_first[msg]]->rtp_pkt_len;
+
+    cmsg = CMSG_FIRSTHDR(hdr);
+
+    cmsg->cmsg_level    = SOL_UDP;
+    cmsg->cmsg_type     = UDP_SEGMENT;
+    cmsg->cmsg_len      = CMSG_LEN(sizeof(seg_len));
+
+    memcpy(CMSG_DATA(cmsg), &seg_len, sizeof(seg_len));
 }
 
 
-static void rtp_thread_create(
+// Add a packet behind the session's header, flushing a full batch.
+static void batch_add(
+    sMGMT_RTP_BATCH        *batch,
+    sSESSION               *session,
+    const sRTP_PKT_DESC    *pkt,
+    unsigned int            timestamp
     )
 {
-    pthread_create(&f_cblk.rtp_thread, NULL, (void *) &rtp_thread, NULL); 
+    struct msghdr          *hdr;
+    struct iovec           *iov;
+    unsigned int            iov_count;
+    unsigned int            i;
+    unsigned int            msg;
+
+
+    i = batch->count;
+
+    sx_nal_to_rtp_util_header_stamp(session->nal_to_rtp_instance,
+                                    &pkt->header,
+                                    timestamp,
+                                    &batch->hdrs[i]);
+
+    // Header here, payload straight from the NAL unit.
+    iov         = &batch->iov[batch->iov_count];
+    iov_count   = sx_nal_to_rtp_util_desc_iov(pkt, &batch->hdrs[i], iov);
+
+    batch->iov_count += iov_count;
+
+    if(batch_msg_extends(batch, session, pkt->rtp_pkt_len))
+    {
+        msg = batch->msg_count - 1;
+
+        // The packet's iovecs follow the message's.
+        batch->msgs[msg].msg_hdr.msg_iovlen += iov_count;
+        batch->msg_bytes[msg]               += pkt->rtp_pkt_len;
+
+        batch_msg_gso_set(batch, msg);
+    }
+    else
+    {
+        msg = batch->msg_count++;
+
+        hdr = &batch->msgs[msg].msg_hdr;
+
+        hdr->msg_name       = &session->peer_addr;
+        hdr->msg_namelen    = sizeof(session->peer_addr);
+        hdr->msg_iov        = iov;
+        hdr->msg_iovlen     = iov_count;
+        hdr->msg_control    = NULL;
+        hdr->msg_controllen = 0;
+
+        batch->msg_first[msg]   = i;
+        batch->msg_bytes[msg]   = pkt->rtp_pkt_len;
+    }
+
+    batch->sessions[i]  = session;
+    batch->pkts[i]      = pkt;
+
+    session->batched++;
 
-    pthread_create(&f_cblk.timer_thread, NULL, (void *) &timer_thread, NULL);
+    batch->count++;
+
+    if(batch->count == MGMT_RTP_BATCH_LEN)
+    {
+        batch_flush(batch);
+    }
 }
 
 
-void sx_mgmt_rtp_init(
-    void
+// --------------------------------------------------------
+// batch_init
+//      Batch for a thread's socket. GSO and io_uring are used if
+//      asked for and the kernel has them.
+//
+static void batch_init(
+    sMGMT_RTP_BATCH    *batch,
+    int                 sock
     )
 {
-    struct mq_attr queue_attr;
+    int     seg_len;
+
+
+    memset(batch, 0, sizeof(sMGMT_RTP_BATCH));
+
+    batch->sock = sock;
+    batch->ring = sx_uring_create(MGMT_RTP_BATCH_LEN);
 
+    if((batch->ring != NULL) && (sx_uring_files_register(batch->ring, &sock, 1) != 0))
+    {
+        logger_log("(mgmt_rtp): io_uring file registration failed, using sendmmsg [errno = %d]", errno);
+
+        sx_uring_destroy(batch->ring);
+
+        batch->ring = NULL;
+    }
 
-    // Set message attributes.
-    queue_attr.mq_flags = 0;
-    queue_attr.mq_maxmsg = 10;
-    queue_attr.mq_msgsize = sizeof(sMGMT_RTP_MSG);
-    queue_attr.mq_curmsgs = 0;
+    if(!f_cblk.config.gso)
+    {
+        return;
+    }
 
-    // Create message queue.
-    f_cblk.msg_queue = mq_open(MGMT_RTP_MSG_QUEUE,
-                               O_CREAT | O_RDWR,
-                               0644,
-                               &queue_attr);
+    // Per socket size 0 leaves it to each message's cmsg.
+    seg_len = 0;
 
-    f_cblk.rtp_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP); 
-    assert(f_cblk.rtp_sock != 0); 
+    batch->gso = (setsockopt(sock, SOL_UDP, UDP_SEGMENT, &seg_len, sizeof(seg_len)) == 0);
 }
 
 
-void sx_mgmt_rtp_open(
-    void
+static void batch_stats_log(
+    const sMGMT_RTP_BATCH  *batch,
+    const char             *name
     )
 {
-    // Create RTSP thread. 
-    rtp_thread_create(); 
+    logger_log("(mgmt_rtp): %s: packets = %d, %s calls = %d, packets per call = %.1f, gso messages = %d, deferred = %d",
+               name,
+               batch->pkt_count,
+               (batch->ring != NULL) ? "io_uring" : "sendmmsg",
+               batch->call_count,
+               (batch->call_count != 0) ? (double) batch->pkt_count / batch->call_count : 0.0,
+               batch->gso_count,
+               batch->defer_count);
+
+    if(batch->ring != NULL)
+    {
+        sx_uring_stats_log(batch->ring, name);
+    }
 }
 
 
-void sx_mgmt_rtp_activate(
-    unsigned int    id, 
-    unsigned int    ip, 
-    unsigned short  port
+// Pacing rate that sends the session's backlog within the pace window,
+// capped at the per-session maximum.
+static void session_rate_set(
+    sSESSION   *session
     )
 {
-    sMGMT_RTP_MSG   msg;
+    unsigned long long  rate;
+    unsigned long long  rate_max;
 
 
-    // Construct message.
-    msg.event                       = MGMT_RTP_EVENT_ACTIVATE;
-    msg.event_data.activate.id      = id;
-    msg.event_data.activate.ip      = ip;
-    msg.event_data.activate.port    = port;
+    rate = 0;
+    if(f_cblk.config.pace_window_us != 0)
+    {
+        rate = (unsigned long long) session->backlog * SX_CLOCK_US_PER_SEC / f_cblk.config.pace_window_us + 1;
+    }
 
-    // Queue message.
-    mq_send(f_cblk.msg_queue,
-            (char *) &msg,
-            sizeof(sMGMT_RTP_MSG),
-            0);
+    rate_max = f_cblk.config.session_rate_max / 8;
+    if((rate_max != 0) && ((rate == 0) || (rate > rate_max)))
+    {
+        rate = rate_max;
+    }
+
+    session->rate = rate;
 }
 
 
-void sx_mgmt_rtp_reset(
-    unsigned int    id
+// Top up the session's send credit for the time passed.
+static void session_tokens_update(
+    sSESSION           *session,
+    unsigned long long  now
     )
 {
-    sMGMT_RTP_MSG   msg;
+    if(session->rate == 0)
+    {
+        session->tokens = MGMT_RTP_PACE_BURST;
+    }
+    else
+    {
+        session->tokens += (long long) ((now - session->tokens_us) * session->rate / SX_CLOCK_US_PER_SEC);
+        if(session->tokens > MGMT_RTP_PACE_BURST)
+        {
+            session->tokens = MGMT_RTP_PACE_BURST;
+        }
+    }
 
+    session->tokens_us = now;
+}
 
-    // Construct message.
-    msg.event   = MGMT_RTP_EVENT_RESET;
-    msg.event_data.reset.id = id; 
 
-    // Queue message.
-    mq_send(f_cblk.msg_queue,
-            (char *) &msg,
-            sizeof(sMGMT_RTP_MSG),
-            0);
+static void session_pace(
+    sSESSION   *session
+    );
+
+
+// --------------------------------------------------------
+// session_enqueue
+//      Queue a NAL unit's packets for the session's pacer. A
+//      session whose queue is full drops the unit and restarts
+//      at the next key unit. So does an interleaved session over
+//      its output budget, without asking for the key unit early.
+//
+static void session_enqueue(
+    sSESSION           *session,
+    sMGMT_RTP_FANOUT   *fanout,
+    unsigned int        timestamp
+    )
+{
+    sMGMT_RTP_PACED    *paced;
+
+
+    if(session->paced_count == MGMT_RTP_PACE_QUEUE_LEN)
+    {
+        session->drop_count++;
+
+        // Later units may reference the lost one.
+        session->idr_observed = 0;
+
+        sx_mgmt_video_keyframe_request();
+
+        return;
+    }
+
+    if(   (session->conn != NULL)
+       && (f_cblk.config.tcp_budget != 0)
+       && (session->backlog != 0)
+       && (session->backlog + fanout->bytes > f_cblk.config.tcp_budget))
+    {
+        // A slow reader skips whole frames rather than fall further
+        // behind, an early key unit would only add to its backlog. A
+        // unit over the budget on its own still goes once caught up.
+        session->skip_count++;
+
+        session->idr_observed = 0;
+
+        return;
+    }
+
+    paced = &session->paced[(session->paced_head + session->paced_count) % MGMT_RTP_PACE_QUEUE_LEN];
+
+    paced->fanout       = fanout;
+    paced->timestamp    = timestamp;
+
+    __atomic_add_fetch(&fanout->ref_count, 1, __ATOMIC_RELAXED);
+
+    if(session->batch_index == session->paced_count)
+    {
+        // Everything before it is batched.
+        session->batch_pkt = fanout->pkts;
+    }
+
+    if(session->paced_count == 0)
+    {
+        session->paced_pkt = fanout->pkts;
+
+        // Credit saved while idle stays capped at the burst size.
+        session_tokens_update(session, sx_clock_mono_us());
+    }
+
+    session->paced_count++;
+    session->backlog += fanout->bytes;
+
+    session_rate_set(session);
+
+    // Send now, or move its timer up to the new rate.
+    session_pace(session);
+}
+
+
+static void fanout_release(
+    sMGMT_RTP_FANOUT   *fanout
+    );
+
+
+// Drop the oldest queued NAL unit.
+static void session_dequeue(
+    sSESSION   *session
+    )
+{
+    fanout_release(session->paced[session->paced_head].fanout);
+
+    session->paced_head     = (session->paced_head + 1) % MGMT_RTP_PACE_QUEUE_LEN;
+    session->paced_count--;
+
+    session->paced_pkt = NULL;
+    if(session->paced_count != 0)
+    {
+        session->paced_pkt = session->paced[session->paced_head].fanout->pkts;
+    }
+}
+
+
+// Empty the session's pace queue. None of it may be batched.
+static void session_flush(
+    sSESSION   *session
+    )
+{
+    assert(session->batched == 0);
+
+    while(session->paced_count != 0)
+    {
+        session_dequeue(session);
+    }
+
+    session->backlog        = 0;
+    session->batch_index    = 0;
+    session->batch_pkt      = NULL;
+
+    sx_timer_cancel(&session->pace_timer);
+}
+
+
+
+// --------------------------------------------------------
+// conn_out_flush
+//      Write what is held for the connection, without blocking.
+//      Called with its mutex held.
+//
+//      Returns 1 once nothing is held.
+//
+static unsigned char conn_out_flush(
+    sMGMT_RTP_CONN *conn
+    )
+{
+    int     rv;
+
+
+    while(conn->out_len != 0)
+    {
+        rv = send(conn->sock, &conn->out[conn->out_head], conn->out_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if(rv < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            if((errno != EAGAIN) && (errno != EWOULDBLOCK))
+            {
+                // Gone, what is held is of no use to anyone.
+                conn->out_len = 0;
+            }
+
+            return (conn->out_len == 0);
+        }
+
+        conn->out_head  += rv;
+        conn->out_len   -= rv;
+    }
+
+    conn->out_head = 0;
+
+    return 1;
+}
+
+
+// Hold len bytes for the connection behind what it already holds.
+// Returns 0 if there is no room.
+static unsigned char conn_out_add(
+    sMGMT_RTP_CONN *conn,
+    const void     *data,
+    unsigned int    len
+    )
+{
+    if(conn->out_head + conn->out_len + len > MGMT_RTP_TCP_OUT_SIZE)
+    {
+        memmove(conn->out, &conn->out[conn->out_head], conn->out_len);
+
+        conn->out_head = 0;
+
+        if(conn->out_len + len > MGMT_RTP_TCP_OUT_SIZE)
+        {
+            return 0;
+        }
+    }
+
+    memcpy(&conn->out[conn->out_head + conn->out_len], data, len);
+
+    conn->out_len += len;
+
+    return 1;
+}
+
+
+// Hold the part of a written packet's iovecs past offset, so nothing
+// else goes on the connection before the rest of it.
+static void conn_out_tail_add(
+    sMGMT_RTP_CONN     *conn,
+    const struct iovec *iov,
+    unsigned int        iov_count,
+    unsigned int        offset
+    )
+{
+    unsigned int    i;
+    unsigned char   added;
+
+
+    for(i = 0; i < iov_count; i++)
+    {
+        if(offset >= iov[i].iov_len)
+        {
+            offset -= iov[i].iov_len;
+            continue;
+        }
+
+        // A packet is well under the size of out, which only holds
+        // responses besides.
+        added = conn_out_add(conn, (char *) iov[i].iov_base + offset, iov[i].iov_len - offset);
+        assert(added);
+
+        offset = 0;
+    }
+}
+
+
+// An interleaved packet went out, or is held for the connection.
+static void session_tcp_pkt_commit(
+    sSESSION               *session,
+    const sRTP_PKT_DESC    *pkt
+    )
+{
+    session->pkt_count++;
+    session->backlog -= pkt->rtp_pkt_len;
+
+    session->paced_pkt = pkt->next;
+    if(session->paced_pkt == NULL)
+    {
+        session_dequeue(session);
+    }
+}
+
+
+// --------------------------------------------------------
+// session_drain_tcp
+//      session_drain() of an interleaved session. Its packets go
+//      straight to the connection, framed, as many per
+//      non-blocking sendmsg() as credit allows. A write ending
+//      inside a packet holds its tail for the connection, the
+//      packets behind it wait for the retry delay. A connection
+//      gone drops what is queued.
+//
+static unsigned long long session_drain_tcp(
+    sSESSION           *session,
+    unsigned long long  now
+    )
+{
+    sMGMT_RTP_CONN         *conn;
+    sMGMT_RTP_PACED        *paced;
+    const sRTP_PKT_DESC    *pkt;
+    const sRTP_PKT_DESC    *pkts[MGMT_RTP_TCP_PKTS];
+    struct msghdr           hdr;
+    unsigned long long      next;
+    unsigned int            index;
+    unsigned int            count;
+    unsigned int            frame_len;
+    unsigned int            sent;
+    unsigned int            k;
+    int                     rv;
+
+
+    if(session->paced_count == 0)
+    {
+        return 0;
+    }
+
+    if(now < session->retry_us)
+    {
+        return session->retry_us;
+    }
+
+    conn = session->conn;
+
+    pthread_mutex_lock(&conn->mutex);
+
+    if(conn->sock < 0)
+    {
+        pthread_mutex_unlock(&conn->mutex);
+
+        session->drop_count += session->paced_count;
+
+        session_flush(session);
+
+        return 0;
+    }
+
+    next = 0;
+
+    if(!conn_out_flush(conn))
+    {
+        session->retry_us = now + MGMT_RTP_PACE_RETRY_US;
+
+        next = session->retry_us;
+    }
+
+    session_tokens_update(session, now);
+
+    while((next == 0) && (session->paced_count != 0))
+    {
+        if(session->tokens < 0)
+        {
+            next = now + (-session->tokens * SX_CLOCK_US_PER_SEC + session->rate - 1) / session->rate;
+            break;
+        }
+
+        // Gather packets from the oldest unsent on.
+        index   = 0;
+        pkt     = session->paced_pkt;
+        count   = 0;
+
+        conn->iov_first[0] = 0;
+
+        while((pkt != NULL) && (count < MGMT_RTP_TCP_PKTS) && (session->tokens >= 0))
+        {
+            paced = &session->paced[(session->paced_head + index) % MGMT_RTP_PACE_QUEUE_LEN];
+
+            sx_nal_to_rtp_util_header_stamp(session->nal_to_rtp_instance,
+                                            &pkt->header,
+                                            paced->timestamp,
+                                            &conn->hdrs[count]);
+
+            conn->prefixes[count][0] = '$';
+            conn->prefixes[count][1] = conn->channel;
+            conn->prefixes[count][2] = pkt->rtp_pkt_len >> 8;
+            conn->prefixes[count][3] = pkt->rtp_pkt_len & 0xFF;
+
+            k = conn->iov_first[count];
+
+            conn->iov[k].iov_base   = conn->prefixes[count];
+            conn->iov[k].iov_len    = MGMT_RTP_TCP_PREFIX_LEN;
+
+            conn->iov_first[count + 1] = k + 1 + sx_nal_to_rtp_util_desc_iov(pkt, &conn->hdrs[count], &conn->iov[k + 1]);
+
+            if(session->rate != 0)
+            {
+                session->tokens -= pkt->rtp_pkt_len;
+            }
+
+            pkts[count++] = pkt;
+
+            pkt = pkt->next;
+            if(pkt == NULL)
+            {
+                index++;
+
+                if(index < session->paced_count)
+                {
+                    pkt = session->paced[(session->paced_head + index) % MGMT_RTP_PACE_QUEUE_LEN].fanout->pkts;
+                }
+            }
+        }
+
+        memset(&hdr, 0, sizeof(hdr));
+
+        hdr.msg_iov     = conn->iov;
+        hdr.msg_iovlen  = conn->iov_first[count];
+
+        do
+        {
+            rv = sendmsg(conn->sock, &hdr, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        } while((rv < 0) && (errno == EINTR));
+
+        conn->write_count++;
+
+        if((rv < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != ENOBUFS))
+        {
+            // Dropped on the next drain, the RTSP manager ends the session.
+            logger_log("(mgmt_rtp): interleaved connection failed [errno = %d]", errno);
+
+            close(conn->sock);
+
+            conn->sock = -1;
+
+            rv = 0;
+        }
+
+        sent = (rv > 0) ? rv : 0;
+
+        for(k = 0; k < count; k++)
+        {
+            frame_len = MGMT_RTP_TCP_PREFIX_LEN + pkts[k]->rtp_pkt_len;
+
+            if(sent == 0)
+            {
+                break;
+            }
+
+            if(sent < frame_len)
+            {
+                conn->short_count++;
+
+                conn_out_tail_add(conn,
+                                  &conn->iov[conn->iov_first[k]],
+                                  conn->iov_first[k + 1] - conn->iov_first[k],
+                                  sent);
+
+                sent = frame_len;
+            }
+
+            sent -= frame_len;
+
+            session_tcp_pkt_commit(session, pkts[k]);
+        }
+
+        if(k < count)
+        {
+            // Put back the ones not written at all.
+            sx_nal_to_rtp_util_sequence_rewind(session->nal_to_rtp_instance, count - k);
+
+            for(; k < count; k++)
+            {
+                if(session->rate != 0)
+                {
+                    session->tokens += pkts[k]->rtp_pkt_len;
+                }
+            }
+
+            session->eagain_count += (conn->sock >= 0);
+        }
+
+        if((k < count) || (conn->out_len != 0))
+        {
+            // The socket buffer is full.
+            session->retry_us = now + MGMT_RTP_PACE_RETRY_US;
+
+            next = session->retry_us;
+        }
+    }
+
+    pthread_mutex_unlock(&conn->mutex);
+
+    return next;
+}
+
+
+// --------------------------------------------------------
+// session_drain
+//      Batch the session's queued packets as far as its send
+//      credit allows. They go out at the next flush of its
+//      thread's batch, or as the batch fills.
+//
+//      Returns when it can send next, 0 once all are batched.
+//
+static unsigned long long session_drain(
+    sSESSION           *session,
+    unsigned long long  now
+    )
+{
+    sMGMT_RTP_PACED        *paced;
+    const sRTP_PKT_DESC    *pkt;
+
+
+    if(session->conn != NULL)
+    {
+        return session_drain_tcp(session, now);
+    }
+
+    if(session->batch_index == session->paced_count)
+    {
+        return 0;
+    }
+
+    if(now < session->retry_us)
+    {
+        return session->retry_us;
+    }
+
+    session_tokens_update(session, now);
+
+    while(session->batch_index < session->paced_count)
+    {
+        if(session->tokens < 0)
+        {
+            // Rate is non-zero, unpaced sessions never run short.
+            return now + (-session->tokens * SX_CLOCK_US_PER_SEC + session->rate - 1) / session->rate;
+        }
+
+        if(now < session->retry_us)
+        {
+            // A full batch was flushed into a full socket buffer.
+            return session->retry_us;
+        }
+
+        paced   = &session->paced[(session->paced_head + session->batch_index) % MGMT_RTP_PACE_QUEUE_LEN];
+        pkt     = session->batch_pkt;
+
+        if(session->rate != 0)
+        {
+            session->tokens -= pkt->rtp_pkt_len;
+        }
+
+        session->batch_pkt = pkt->next;
+        if(session->batch_pkt == NULL)
+        {
+            session->batch_index++;
+
+            if(session->batch_index < session->paced_count)
+            {
+                session->batch_pkt = session->paced[(session->paced_head + session->batch_index) % MGMT_RTP_PACE_QUEUE_LEN].fanout->pkts;
+            }
+        }
+
+        // Last, a flush moves the cursors.
+        batch_add(session->batch, session, pkt, paced->timestamp);
+    }
+
+    return 0;
+}
+
+
+// Send what the session's credit allows, its timer sends the rest.
+static void session_pace(
+    sSESSION   *session
+    )
+{
+    unsigned long long  next;
+
+
+    next = session_drain(session, sx_clock_mono_us());
+    if(next != 0)
+    {
+        sx_timer_arm(&session->pace_timer, next);
+    }
+}
+
+
+static void pace_timer_cback(
+    void   *arg
+    )
+{
+    session_pace(arg);
+}
+
+
+// --------------------------------------------------------
+// session_bind
+//      Hand the session's pacing to the thread owning wheel and
+//      batch. That thread must be idle or locked out, with its
+//      batch flushed.
+//
+static void session_bind(
+    sSESSION           *session,
+    SX_TIMER_WHEEL      wheel,
+    sMGMT_RTP_BATCH    *batch
+    )
+{
+    assert(session->batched == 0);
+
+    sx_timer_cancel(&session->pace_timer);
+
+    sx_timer_init(&session->pace_timer, wheel, pace_timer_cback, session);
+
+    session->batch = batch;
+
+    if(session->paced_count != 0)
+    {
+        // Carry on from the new thread's next round.
+        sx_timer_arm(&session->pace_timer, sx_clock_mono_us());
+    }
+}
+
+
+// Mailbox wait until a pacer deadline.
+static unsigned int pace_timeout_get(
+    unsigned long long  next
+    )
+{
+    unsigned long long  now;
+
+
+    if(next == 0)
+    {
+        return SX_MAILBOX_WAIT_FOREVER;
+    }
+
+    now = sx_clock_mono_us();
+
+    return (next > now) ? (unsigned int) (next - now) : 0;
+}
+
+
+static void idle_state_handler(
+    sMGMT_RTP_MSG  *msg
+    )
+{
+    
+}
+
+
+// Wait until every worker has sent what it was posted. Until then it
+// owns the state of the sessions in its shard.
+static void workers_quiesce(
+    void
+    )
+{
+    sMGMT_RTP_WORKER   *worker;
+    unsigned int        i;
+
+
+    for(i = 0; i < f_cblk.config.workers; i++)
+    {
+        worker = &f_cblk.workers[i];
+
+        while(__atomic_load_n(&worker->sent, __ATOMIC_ACQUIRE) != worker->posted)
+        {
+            sched_yield();
+        }
+    }
+}
+
+
+// Keep the workers, quiesced, off their sessions (1) or let them
+// back on (0).
+static void workers_lock(
+    unsigned char   lock
+    )
+{
+    unsigned int    i;
+
+
+    for(i = 0; i < f_cblk.config.workers; i++)
+    {
+        if(lock)
+        {
+            pthread_mutex_lock(&f_cblk.workers[i].mutex);
+        }
+        else
+        {
+            pthread_mutex_unlock(&f_cblk.workers[i].mutex);
+        }
+    }
+}
+
+
+// Deal the sessions in use out to the workers, round robin, or keep
+// them on the RTP thread without workers. Workers must be quiesced and
+// locked.
+static void workers_assign(
+    void
+    )
+{
+    sMGMT_RTP_WORKER   *worker;
+    unsigned int        i;
+    unsigned int        next;
+
+
+    if(f_cblk.config.workers == 0)
+    {
+        for(i = 0; i < MGMT_RTP_SESSION_NUM; i++)
+        {
+            if(f_cblk.sessions[i].in_use)
+            {
+                session_bind(&f_cblk.sessions[i], f_cblk.wheel, &f_cblk.batch);
+            }
+        }
+
+        return;
+    }
+
+    for(i = 0; i < f_cblk.config.workers; i++)
+    {
+        f_cblk.workers[i].session_count = 0;
+    }
+
+    next = 0;
+
+    for(i = 0; i < MGMT_RTP_SESSION_NUM; i++)
+    {
+        if(!f_cblk.sessions[i].in_use)
+        {
+            continue;
+        }
+
+        worker = &f_cblk.workers[next];
+        worker->session_ids[worker->session_count++] = i;
+
+        session_bind(&f_cblk.sessions[i], worker->wheel, &worker->batch);
+
+        next = (next + 1) % f_cblk.config.workers;
+    }
+}
+
+
+// Have every worker with sessions run its wheel, it may have been
+// handed timers while waiting on an older deadline.
+static void workers_wake(
+    void
+    )
+{
+    sMGMT_RTP_WORKER       *worker;
+    sMGMT_RTP_WORKER_MSG    msg;
+    unsigned int            i;
+
+
+    msg.fanout = NULL;
+
+    for(i = 0; i < f_cblk.config.workers; i++)
+    {
+        worker = &f_cblk.workers[i];
+
+        if(worker->session_count == 0)
+        {
+            continue;
+        }
+
+        sx_mailbox_send(worker->mailbox, SX_MAILBOX_LANE_DATA, &msg);
+
+        worker->posted++;
+    }
+}
+
+
+// Connection of an RTSP session playing interleaved, NULL if it isn't.
+static sMGMT_RTP_CONN * conn_get(
+    unsigned int    id
+    )
+{
+    sMGMT_RTP_CONN *conn;
+    unsigned char   open;
+
+
+    conn = &f_conns[id];
+
+    pthread_mutex_lock(&conn->mutex);
+
+    open = (conn->sock >= 0);
+
+    pthread_mutex_unlock(&conn->mutex);
+
+    return open ? conn : NULL;
+}
+
+
+static void activate_handler(
+    sMGMT_RTP_MSG  *msg
+    )
+{
+    sSESSION *session;
+
+
+    logger_log("MGMT_RTP: ACTIVATE received [id = %d, interleaved = %d]",
+               msg->event_data.activate.id,
+               conn_get(msg->event_data.activate.id) != NULL);
+
+    // Sessions may move, nothing of theirs is left half sent.
+    batch_flush(&f_cblk.batch);
+
+    workers_quiesce();
+
+    workers_lock(1);
+
+    session = &f_cblk.sessions[msg->event_data.activate.id];
+
+    if(!session->in_use)
+    {
+        f_cblk.session_count++;
+    }
+    else
+    {
+        session_flush(session);
+
+        sx_nal_to_rtp_util_destroy(session->nal_to_rtp_instance);
+    }
+
+    session->in_use                     = 1;
+    session->conn                       = conn_get(msg->event_data.activate.id);
+    session->peer_addr.sin_family       = AF_INET;
+    session->peer_addr.sin_addr.s_addr  = msg->event_data.activate.ip;
+    session->peer_addr.sin_port         = htons(msg->event_data.activate.port);
+    bzero(&(session->peer_addr.sin_zero), 8);
+
+    session->idr_observed   = 0;
+    session->pps_sent       = 0;
+    session->sps_sent       = 0;
+
+    session->nal_to_rtp_instance = sx_nal_to_rtp_util_create();
+
+    session->retry_us       = 0;
+    session->pkt_count      = 0;
+    session->eagain_count   = 0;
+    session->error_count    = 0;
+    session->drop_count     = 0;
+    session->skip_count     = 0;
+
+    f_cblk.state = MGMT_RTP_STATE_ACTIVE;
+
+    workers_assign();
+
+    workers_lock(0);
+
+    workers_wake();
+
+    // Don't make the session wait out the GOP for its first IDR.
+    sx_mgmt_video_keyframe_request();
+}
+
+
+static void reset_handler(
+    sMGMT_RTP_MSG  *msg
+    )
+{
+    sMGMT_RTP_WORKER   *worker;
+    unsigned int        i;
+
+
+    logger_log("MGMT_RTP: RESET received [id = %d]",
+            msg->event_data.reset.id);
+
+    batch_flush(&f_cblk.batch);
+
+    workers_quiesce();
+
+    workers_lock(1);
+
+    sSESSION *session = &f_cblk.sessions[msg->event_data.reset.id];
+
+    if(session->in_use)
+    {
+        f_cblk.session_count--;
+
+        logger_log("(mgmt_rtp): session %d: packets = %d, deferred = %d, errors = %d, dropped = %d, skipped = %d",
+                   msg->event_data.reset.id,
+                   session->pkt_count,
+                   session->eagain_count,
+                   session->error_count,
+                   session->drop_count,
+                   session->skip_count);
+
+        if(session->conn != NULL)
+        {
+            logger_log("(mgmt_rtp): session %d: interleaved writes = %d, ending inside a packet = %d",
+                       msg->event_data.reset.id,
+                       session->conn->write_count,
+                       session->conn->short_count);
+        }
+    }
+
+    session->in_use = 0;
+
+    session_flush(session);
+
+    session->conn = NULL;
+
+    sx_nal_to_rtp_util_destroy(session->nal_to_rtp_instance);
+
+    session->nal_to_rtp_instance = NULL;
+
+    workers_assign();
+
+    workers_lock(0);
+
+    workers_wake();
+
+    sx_mailbox_stats_log(f_cblk.mailbox, "mgmt_rtp");
+
+    if(!sx_reactor_enabled())
+    {
+        sx_timer_wheel_stats_log(f_cblk.wheel, "mgmt_rtp");
+    }
+
+    if(f_cblk.config.workers == 0)
+    {
+        batch_stats_log(&f_cblk.batch, "mgmt_rtp");
+    }
+
+    for(i = 0; i < f_cblk.config.workers; i++)
+    {
+        worker = &f_cblk.workers[i];
+
+        logger_log("(mgmt_rtp): worker %d: sessions = %d, nal units = %d",
+                   i,
+                   worker->session_count,
+                   worker->sent);
+
+        // Read while the worker may be running, near enough for a log.
+        sx_timer_wheel_stats_log(worker->wheel, "mgmt_rtp worker");
+
+        batch_stats_log(&worker->batch, "worker");
+    }
+}
+
+
+// Packetize a NAL unit, taking over the caller's reference to it.
+static sMGMT_RTP_FANOUT * fanout_create(
+    sMGMT_VIDEO_NAL_UNIT   *nal_unit
+    )
+{
+    sMGMT_RTP_FANOUT   *fanout;
+    sRTP_PKT_DESC      *pkt;
+
+
+    fanout = sx_slab_alloc(sizeof(sMGMT_RTP_FANOUT));
+
+    fanout->nal_unit    = nal_unit;
+    fanout->pkts        = sx_nal_to_rtp_util_describe(nal_unit->seg,
+                                                      nal_unit->nal_unit_len,
+                                                      (nal_unit->flags & SX_NAL_FLAG_AU_END) != 0);
+    fanout->bytes       = 0;
+    fanout->ref_count   = 1;
+
+    for(pkt = fanout->pkts; pkt != NULL; pkt = pkt->next)
+    {
+        fanout->bytes += pkt->rtp_pkt_len;
+    }
+
+    return fanout;
+}
+
+
+// Last holder of a NAL unit frees it.
+static void fanout_release(
+    sMGMT_RTP_FANOUT   *fanout
+    )
+{
+    if(__atomic_sub_fetch(&fanout->ref_count, 1, __ATOMIC_ACQ_REL) != 0)
+    {
+        return;
+    }
+
+    sx_nal_to_rtp_util_desc_free(fanout->pkts);
+
+    sx_mgmt_video_free_nal_unit(fanout->nal_unit);
+
+    sx_slab_free(fanout);
+}
+
+
+// Queue one NAL unit for one session. A joining session gets the
+// cached SPS and PPS first, then starts at a key unit.
+static void session_service(
+    sSESSION               *session, 
+    sMGMT_RTP_FANOUT       *fanout
+    )
+{
+    sMGMT_VIDEO_NAL_UNIT   *nal_unit;
+    sMGMT_VIDEO_NAL_UNIT   *ps_nal_unit;
+    sMGMT_RTP_FANOUT       *ps_fanout;
+    unsigned int            timestamp;
+
+
+    nal_unit = fanout->nal_unit;
+
+    if(!session->sps_sent)
+    {
+        ps_nal_unit = sx_mgmt_video_sps_get();
+        if(ps_nal_unit == NULL)
+        {
+            logger_log("mgmt_video_get_sps_nal_unit() returned NULL!");
+            return;
+        }
+
+        session->sps_sent = 1;
+    }
+    else if(!session->pps_sent)
+    {
+        ps_nal_unit = sx_mgmt_video_pps_get();
+        if(ps_nal_unit == NULL)
+        {
+            logger_log("mgmt_video_get_pps_nal_unit() returned NULL!");
+            return;
+        }
+
+        session->pps_sent = 1;
+    }
+    else
+    {
+        if(!session->idr_observed)
+        {
+            // Start with key units.
+            if(!sx_mgmt_video_is_key_frame(nal_unit))
+            {
+                return;
+            }
+
+            session->idr_observed = 1;
+        }
+
+        timestamp = sx_nal_to_rtp_util_timestamp_get(session->nal_to_rtp_instance, nal_unit->pts);
+
+        session_enqueue(session, fanout, timestamp);
+
+        return;
+    }
+
+    // The cached SPS/PPS is packetized for this session only, stamped
+    // with the unit it precedes.
+    timestamp = sx_nal_to_rtp_util_timestamp_get(session->nal_to_rtp_instance, nal_unit->pts);
+
+    ps_fanout = fanout_create(ps_nal_unit);
+
+    session_enqueue(session, ps_fanout, timestamp);
+
+    fanout_release(ps_fanout);
+}
+
+
+// Send worker, queues each NAL unit posted to the sessions in its shard
+// and paces them out on its wheel.
+static void worker_thread(
+    void   *arg
+    )
+{
+    sMGMT_RTP_WORKER       *worker;
+    sMGMT_RTP_WORKER_MSG    msg;
+    unsigned long long      next;
+    unsigned char           received;
+    unsigned int            i;
+
+
+    worker = arg;
+
+    next = 0;
+
+    while(1)
+    {
+        received = sx_mailbox_recv_wait(worker->mailbox, &msg, pace_timeout_get(next));
+
+        pthread_mutex_lock(&worker->mutex);
+
+        // No NAL unit only wakes it to run the wheel.
+        if(received && (msg.fanout != NULL))
+        {
+            for(i = 0; i < worker->session_count; i++)
+            {
+                session_service(&f_cblk.sessions[worker->session_ids[i]], msg.fanout);
+            }
+
+            fanout_release(msg.fanout);
+        }
+
+        sx_timer_wheel_run(worker->wheel);
+
+        batch_flush(&worker->batch);
+
+        next = sx_timer_wheel_next_get(worker->wheel);
+
+        pthread_mutex_unlock(&worker->mutex);
+
+        if(received)
+        {
+            __atomic_add_fetch(&worker->sent, 1, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+
+// Send one NAL unit to every active session. The unit is packetized
+// once, sessions only differ in their RTP headers.
+static void nal_unit_service(
+    sMGMT_VIDEO_NAL_UNIT   *nal_unit
+    )
+{
+    sMGMT_RTP_FANOUT       *fanout;
+    sMGMT_RTP_WORKER_MSG    msg;
+    sMGMT_RTP_WORKER       *worker;
+    unsigned int            i;
+
+
+    if(f_cblk.session_count == 0)
+    {
+        sx_mgmt_video_free_nal_unit(nal_unit);
+        return;
+    }
+
+    fanout = fanout_create(nal_unit);
+
+    if(f_cblk.config.workers == 0)
+    {
+        // Queue on this thread, its wheel paces them out.
+        for(i = 0; i < MGMT_RTP_SESSION_NUM; i++)
+        {
+            if(f_cblk.sessions[i].in_use)
+            {
+                session_service(&f_cblk.sessions[i], fanout);
+            }
+        }
+
+        fanout_release(fanout);
+
+        return;
+    }
+
+    msg.fanout = fanout;
+
+    for(i = 0; i < f_cblk.config.workers; i++)
+    {
+        worker = &f_cblk.workers[i];
+
+        if(worker->session_count == 0)
+        {
+            continue;
+        }
+
+        __atomic_add_fetch(&fanout->ref_count, 1, __ATOMIC_RELAXED);
+
+        // Waits while the worker is a lane behind, the video queue
+        // policy then applies upstream.
+        sx_mailbox_send(worker->mailbox, SX_MAILBOX_LANE_DATA, &msg);
+
+        worker->posted++;
+    }
+
+    fanout_release(fanout);
+}
+
+
+static void service_handler(
+    sMGMT_RTP_MSG  *msg
+    )
+{
+    sMGMT_VIDEO_NAL_UNIT   *nal_units[MGMT_RTP_SERVICE_BATCH];
+    unsigned int            count;
+    unsigned int            i;
+
+
+    // Re-arm the video notification before draining so no arrival is missed.
+    __sync_fetch_and_and(&f_cblk.service_pending, 0);
+
+    // Drain what is pending, a batch per queue lock.
+    count = sx_mgmt_video_get_nal_units(nal_units, MGMT_RTP_SERVICE_BATCH);
+
+    for(i = 0; i < count; i++)
+    {
+        nal_unit_service(nal_units[i]);
+    }
+
+    if(count < MGMT_RTP_SERVICE_BATCH)
+    {
+        return;
+    }
+
+    // A producer blocked on a full queue refills it as fast as we drain.
+    // Continue after any control message, they are received first.
+    sx_mgmt_rtp_service();
+}
+
+
+static void rtp_msg_handle(
+    sMGMT_RTP_MSG  *msg
+    )
+{
+    switch(msg->event)
+    {
+        case MGMT_RTP_EVENT_ACTIVATE:
+        {
+            activate_handler(msg);
+            break;
+        }
+        case MGMT_RTP_EVENT_RESET:
+        {
+            reset_handler(msg);
+            break; 
+        }
+        case MGMT_RTP_EVENT_SERVICE:
+        {
+            service_handler(msg);
+            break; 
+        }
+        default:
+        {
+            assert(0);
+        }
+    }
+}
+
+
+static void rtp_thread(
+    void * arg
+    )
+{
+    sMGMT_RTP_MSG           msg;
+
+
+    while(1)
+    {
+        if(sx_mailbox_recv_wait(f_cblk.mailbox,
+                                &msg,
+                                pace_timeout_get(sx_timer_wheel_next_get(f_cblk.wheel))))
+        {
+            rtp_msg_handle(&msg);
+        }
+
+        sx_timer_wheel_run(f_cblk.wheel);
+
+        batch_flush(&f_cblk.batch);
+    }
+}
+
+
+// Mailbox readable, reactor thread. Pace timers go on the reactor's
+// wheel, the batch is flushed at the end of the round.
+static void mailbox_cback(
+    void   *arg
+    )
+{
+    sMGMT_RTP_MSG           msg;
+
+
+    while(sx_mailbox_poll(f_cblk.mailbox, &msg))
+    {
+        rtp_msg_handle(&msg);
+    }
+}
+
+
+// Does a compound RTCP packet carry a PLI or FIR?
+static unsigned char rtcp_keyframe_requested(
+    const unsigned char    *pkt,
+    unsigned int            len
+    )
+{
+    unsigned int    pos;
+    unsigned int    pkt_len;
+    unsigned char   fmt;
+    unsigned char   pt;
+
+
+    pos = 0;
+
+    while(pos + 4 <= len)
+    {
+        if((pkt[pos] >> 6) != 2)
+        {
+            // Not RTCP version 2.
+            return 0;
+        }
+
+        fmt     = pkt[pos] & 0x1F;
+        pt      = pkt[pos + 1];
+        pkt_len = ((pkt[pos + 2] << 8 | pkt[pos + 3]) + 1) * 4;
+
+        if(pos + pkt_len > len)
+        {
+            return 0;
+        }
+
+        if(   (pt == RTCP_PT_FIR_LEGACY)
+           || ((pt == RTCP_PT_PSFB) && ((fmt == RTCP_PSFB_FMT_PLI) || (fmt == RTCP_PSFB_FMT_FIR))))
+        {
+            return 1;
+        }
+
+        pos += pkt_len;
+    }
+
+    return 0;
+}
+
+
+// Pass a keyframe request in a compound RTCP packet on.
+static void rtcp_input(
+    unsigned int            ip,
+    const unsigned char    *pkt,
+    unsigned int            len
+    )
+{
+    unsigned int    count;
+
+
+    if(!rtcp_keyframe_requested(pkt, len))
+    {
+        return;
+    }
+
+    // Over UDP and from RTSP connections.
+    count = __atomic_add_fetch(&f_cblk.rtcp_keyframe_count, 1, __ATOMIC_RELAXED);
+
+    logger_log("MGMT_RTP: PLI/FIR received [ip = 0x%x, count = %d]",
+               ip,
+               count);
+
+    // Coalesced downstream, a burst of these costs one IDR.
+    sx_mgmt_video_keyframe_request();
+}
+
+
+// Receive RTCP from all sessions and pass keyframe requests on.
+// Take one RTCP packet and act on keyframe requests.
+static void rtcp_receive(
+    void   *arg
+    )
+{
+    unsigned char       pkt[MGMT_RTP_RTCP_PKT_SIZE_MAX];
+    struct sockaddr_in  addr;
+    socklen_t           addr_len;
+    int                 len;
+
+
+    addr_len = sizeof(addr);
+
+    len = recvfrom(f_cblk.rtcp_sock,
+                   pkt,
+                   sizeof(pkt),
+                   0,
+                   (struct sockaddr *) &addr,
+                   &addr_len);
+    if(len <= 0)
+    {
+        return;
+    }
+
+    rtcp_input(addr.sin_addr.s_addr, pkt, len);
+}
+
+
+static void rtcp_thread(
+    void * arg
+    )
+{
+    while(1)
+    {
+        rtcp_receive(NULL);
+    }
+}
+
+
+static void rtp_thread_create(
+    )
+{
+    pthread_create(&f_cblk.rtp_thread, NULL, (void *) &rtp_thread, NULL); 
+
+    pthread_create(&f_cblk.rtcp_thread, NULL, (void *) &rtcp_thread, NULL); 
+}
+
+
+// UDP socket bound to a local port. A shared port can be bound by
+// several sockets, the send workers each have their own. Sends on a
+// shared socket never block, a full buffer is retried by the pacer.
+static int sock_bind(
+    unsigned short  port,
+    unsigned char   shared
+    )
+{
+    struct sockaddr_in  addr;
+    int                 sock;
+    int                 one;
+    int                 rv;
+
+
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP); 
+    assert(sock >= 0); 
+
+    if(shared)
+    {
+        one = 1;
+
+        rv = setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+        assert(rv == 0);
+
+        rv = fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+        assert(rv == 0);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+
+    addr.sin_family         = AF_INET;
+    addr.sin_addr.s_addr    = htonl(INADDR_ANY);
+    addr.sin_port           = htons(port);
+
+    rv = bind(sock, (struct sockaddr *) &addr, sizeof(addr));
+    assert(rv == 0);
+
+    return sock;
+}
+
+
+// Pin a worker to a core of its own. Core 0 is left to the camera and
+// manager threads when there are cores to spare.
+static void worker_affinity_set(
+    sMGMT_RTP_WORKER   *worker
+    )
+{
+    cpu_set_t   cpus;
+    long        cpu_num;
+    int         rv;
+
+
+    cpu_num = sysconf(_SC_NPROCESSORS_ONLN);
+    if(cpu_num < 2)
+    {
+        return;
+    }
+
+    CPU_ZERO(&cpus);
+    CPU_SET(1 + worker->index % (cpu_num - 1), &cpus);
+
+    rv = pthread_setaffinity_np(worker->thread_id, sizeof(cpus), &cpus);
+    if(rv != 0)
+    {
+        logger_log("(mgmt_rtp): worker %d affinity not set [rv = %d]", worker->index, rv);
+    }
+}
+
+
+// --------------------------------------------------------
+// sx_mgmt_rtp_config_get
+//      Current (or default) configuration.
+//
+void sx_mgmt_rtp_config_get(
+    sSX_MGMT_RTP_CONFIG        *config
+    )
+{
+    *config = f_cblk.config;
+}
+
+
+// --------------------------------------------------------
+// sx_mgmt_rtp_config_set
+//      Must be called before sx_mgmt_rtp_init().
+//
+void sx_mgmt_rtp_config_set(
+    const sSX_MGMT_RTP_CONFIG  *config
+    )
+{
+    assert(config->workers <= SX_MGMT_RTP_WORKERS_MAX);
+
+    f_cblk.config = *config;
+}
+
+
+void sx_mgmt_rtp_init(
+    void
+    )
+{
+    sMGMT_RTP_WORKER   *worker;
+    unsigned int        i;
+
+
+    // Create mailbox.
+    f_cblk.mailbox = sx_mailbox_create(sizeof(sMGMT_RTP_MSG), MGMT_RTP_MAILBOX_LANE_SIZE);
+
+    f_cblk.wheel = sx_reactor_enabled() ? sx_reactor_wheel_get() : sx_timer_wheel_create();
+
+    // Send from the ports SETUP advertises, receivers direct RTCP there.
+    f_cblk.rtp_sock     = sock_bind(SX_MGMT_RTP_SERVER_PORT, 1); 
+    f_cblk.rtcp_sock    = sock_bind(SX_MGMT_RTP_SERVER_PORT + 1, 0); 
+
+    batch_init(&f_cblk.batch, f_cblk.rtp_sock);
+
+    for(i = 0; i < MGMT_RTP_SESSION_NUM; i++)
+    {
+        pthread_mutex_init(&f_conns[i].mutex, NULL);
+
+        f_conns[i].sock = -1;
+    }
+
+    for(i = 0; i < f_cblk.config.workers; i++)
+    {
+        worker = &f_cblk.workers[i];
+
+        worker->index   = i;
+        worker->sock    = sock_bind(SX_MGMT_RTP_SERVER_PORT, 1);
+        worker->mailbox = sx_mailbox_create(sizeof(sMGMT_RTP_WORKER_MSG), MGMT_RTP_WORKER_LANE_SIZE);
+        worker->wheel   = sx_timer_wheel_create();
+
+        batch_init(&worker->batch, worker->sock);
+
+        pthread_mutex_init(&worker->mutex, NULL);
+    }
+}
+
+
+void sx_mgmt_rtp_open(
+    void
+    )
+{
+    sMGMT_RTP_WORKER   *worker;
+    unsigned int        i;
+
+
+    for(i = 0; i < f_cblk.config.workers; i++)
+    {
+        worker = &f_cblk.workers[i];
+
+        pthread_create(&worker->thread_id, NULL, (void *) &worker_thread, worker);
+
+        worker_affinity_set(worker);
+    }
+
+    logger_log("(mgmt_rtp_open): %d send workers, pace window = %d us, session rate max = %d bps, gso = %d, io_uring = %d",
+               f_cblk.config.workers,
+               f_cblk.config.pace_window_us,
+               f_cblk.config.session_rate_max,
+               f_cblk.batch.gso,
+               f_cblk.batch.ring != NULL);
+
+    if(sx_reactor_enabled())
+    {
+        sx_reactor_mailbox_add(f_cblk.mailbox, mailbox_cback, NULL);
+
+        sx_reactor_fd_add(f_cblk.rtcp_sock, rtcp_receive, NULL);
+
+        sx_reactor_flush_add(batch_flush_cback, &f_cblk.batch);
+
+        return;
+    }
+
+    // Create RTSP thread. 
+    rtp_thread_create(); 
+}
+
+
+void sx_mgmt_rtp_activate(
+    unsigned int    id, 
+    unsigned int    ip, 
+    unsigned short  port
+    )
+{
+    sMGMT_RTP_MSG   msg;
+
+
+    // Construct message.
+    msg.event                       = MGMT_RTP_EVENT_ACTIVATE;
+    msg.event_data.activate.id      = id;
+    msg.event_data.activate.ip      = ip;
+    msg.event_data.activate.port    = port;
+
+    // Queue message.
+    sx_mailbox_send(f_cblk.mailbox, SX_MAILBOX_LANE_CONTROL, &msg);
+}
+
+
+void sx_mgmt_rtp_reset(
+    unsigned int    id
+    )
+{
+    sMGMT_RTP_MSG   msg;
+
+
+    // Construct message.
+    msg.event   = MGMT_RTP_EVENT_RESET;
+    msg.event_data.reset.id = id; 
+
+    // Queue message.
+    sx_mailbox_send(f_cblk.mailbox, SX_MAILBOX_LANE_CONTROL, &msg);
+}
+
+
+// --------------------------------------------------------
+// sx_mgmt_rtp_service
+//      NAL units are pending in the video manager. Coalesced,
+//      at most one SERVICE message is queued at a time.
+//
+void sx_mgmt_rtp_service(
+    void
+    )
+{
+    sMGMT_RTP_MSG   msg;
+
+
+    if(__sync_lock_test_and_set(&f_cblk.service_pending, 1))
+    {
+        return;
+    }
+
+    // Construct message.
+    msg.event = MGMT_RTP_EVENT_SERVICE;
+
+    // Queue message.
+    sx_mailbox_send(f_cblk.mailbox, SX_MAILBOX_LANE_DATA, &msg);
+}
+
+
+// --------------------------------------------------------
+// sx_mgmt_rtp_interleave_open
+//      RTSP session id plays over its connection, on channel and
+//      the one above for RTCP. Call before reporting its PLAY. The
+//      connection is duplicated, it stays up until closed here.
+//
+void sx_mgmt_rtp_interleave_open(
+    unsigned int    id,
+    int             tcp_sock,
+    unsigned char   channel
+    )
+{
+    sMGMT_RTP_CONN *conn;
+
+
+    assert(id < MGMT_RTP_SESSION_NUM);
+
+    conn = &f_conns[id];
+
+    pthread_mutex_lock(&conn->mutex);
+
+    assert(conn->sock < 0);
+
+    conn->sock          = dup(tcp_sock);
+    conn->channel       = channel;
+    conn->out_head      = 0;
+    conn->out_len       = 0;
+    conn->write_count   = 0;
+    conn->short_count   = 0;
+
+    pthread_mutex_unlock(&conn->mutex);
+}
+
+
+// --------------------------------------------------------
+// sx_mgmt_rtp_interleave_write
+//      Write RTSP data on an interleaved session's connection,
+//      between packets. What the socket doesn't take goes with
+//      the session's next packets.
+//
+//      Returns 0 if it was dropped, the connection is gone or
+//      too far behind.
+//
+unsigned char sx_mgmt_rtp_interleave_write(
+    unsigned int    id,
+    const char     *data,
+    unsigned int    len
+    )
+{
+    sMGMT_RTP_CONN *conn;
+    unsigned char   added;
+
+
+    conn = &f_conns[id];
+
+    pthread_mutex_lock(&conn->mutex);
+
+    added = 0;
+
+    if(conn->sock >= 0)
+    {
+        added = conn_out_add(conn, data, len);
+
+        conn_out_flush(conn);
+    }
+
+    pthread_mutex_unlock(&conn->mutex);
+
+    return added;
+}
+
+
+// --------------------------------------------------------
+// sx_mgmt_rtp_interleave_close
+//      RTSP session id is over. Write what is held if the socket
+//      takes it and close the duplicate, its packets still queued
+//      are dropped.
+//
+void sx_mgmt_rtp_interleave_close(
+    unsigned int    id
+    )
+{
+    sMGMT_RTP_CONN *conn;
+
+
+    conn = &f_conns[id];
+
+    pthread_mutex_lock(&conn->mutex);
+
+    if(conn->sock >= 0)
+    {
+        conn_out_flush(conn);
+
+        close(conn->sock);
+
+        conn->sock = -1;
+    }
+
+    pthread_mutex_unlock(&conn->mutex);
+}
+
+
+// --------------------------------------------------------
+// sx_mgmt_rtp_rtcp_input
+//      RTCP a client sent on its RTSP connection.
+//
+void sx_mgmt_rtp_rtcp_input(
+    unsigned int            ip,
+    const unsigned char    *pkt,
+    unsigned int            len
+    )
+{
+    rtcp_input(ip, pkt, len);
 }
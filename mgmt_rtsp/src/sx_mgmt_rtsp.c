@@ -1,6 +1,10 @@
 #include "stdio.h" 
 #include "stdlib.h" 
 #include "string.h" 
+#include "unistd.h"
+#include "errno.h"
+#include "pthread.h"
+#include "stdint.h"
 
 #include <sys/socket.h>
 #include <netinet/in.h> 
@@ -8,10 +12,17 @@
 
 #include "assert.h"
 
+#include "sx_reactor.h"
+#include "sx_uring.h"
 #include "sx_mgmt_rtsp.h"
+#include "sx_mgmt_rtp.h"
 
 #define RTSP_BUF_SIZE_MAX   2048
 #define MGMT_RTSP_PORT      8554
+#define MGMT_RTSP_SESSION_NUM   32
+
+// Slots of a session's io_uring, responses go one at a time.
+#define MGMT_RTSP_RING_LEN  4
 
 #define OPTIONS             "OPTIONS"
 #define DESCRIBE            "DESCRIBE"
@@ -39,6 +50,13 @@ typedef struct
     unsigned short  client_port; 
     unsigned char   client_ip_str[16]; 
     pthread_t       rtsp_thread; 
+    unsigned char   interleaved;    ///< SETUP asked for RTP over this connection.
+    unsigned char   channel;        ///< Interleaved RTP channel, RTCP is the one above.
+    unsigned char   playing;        ///< RTP is on the connection, responses go between its packets.
+    unsigned int    frame_skip;     ///< Bytes still to come of a '$' frame split across reads.
+    unsigned char   frame_hdr[4];   ///< '$' frame header split across reads.
+    unsigned char   frame_hdr_len;  ///< Bytes of it read, 0 = none.
+    SX_URING        ring;           ///< Response writes, the connection is fixed file 0. NULL = write().
 
 } sMGMT_RTSP_SESSION; 
 
@@ -49,7 +67,8 @@ typedef struct
     int                 rtsp_sock; 
     fSX_MGMT_RTSP_CBACK    user_cback; 
     void               *user_arg; 
-    sMGMT_RTSP_SESSION  session[32]; 
+    sMGMT_RTSP_SESSION  session[MGMT_RTSP_SESSION_NUM]; 
+    char                tx_bufs[MGMT_RTSP_SESSION_NUM][RTSP_BUF_SIZE_MAX];  ///< Registered with the session's ring.
 
 } sMGMT_RTSP_CBLK; 
 
@@ -67,7 +86,7 @@ static unsigned int session_instance_alloc(
 
     // TODO: mutex
 
-    for(i = 0; i < 32; i++)
+    for(i = 0; i < MGMT_RTSP_SESSION_NUM; i++)
     {
         if(!f_cblk.session[i].in_use)
         {
@@ -142,6 +161,34 @@ static char * get_url(
 }
 
 
+// Interleaved TCP transport asked for? Its RTP channel goes in channel,
+// 0 if the client leaves it to us.
+static unsigned char get_interleaved(
+    char           *msg, 
+    unsigned char  *channel
+    )
+{
+#define TCP_TRANSPORT   "RTP/AVP/TCP"
+#define INTERLEAVED     "interleaved="
+
+    char *temp = strstr(msg, TCP_TRANSPORT); 
+    if(temp == NULL)
+    {
+        return 0; 
+    }
+
+    *channel = 0; 
+
+    temp = strstr(temp, INTERLEAVED); 
+    if(temp != NULL)
+    {
+        *channel = atoi(temp + strlen(INTERLEAVED)); 
+    }
+
+    return 1; 
+}
+
+
 static unsigned short get_client_port(
     char   *msg
     )
@@ -248,11 +295,31 @@ static char * setup_handler(
 {
     unsigned int cseq = get_cseq(msg_rx); 
 
-    unsigned short dst_port = get_client_port(msg_rx); 
-
     // Allocate buffer. 
     char * out = malloc(RTSP_BUF_SIZE_MAX); 
 
+    session->interleaved = get_interleaved(msg_rx, &session->channel); 
+    if(session->interleaved)
+    {
+        // RTP and RTCP go on this connection. 
+        snprintf(out, 
+                RTSP_BUF_SIZE_MAX, 
+                "RTSP/1.0 200 OK\r\n"
+                "CSeq: %d\r\n"
+                "Transport: RTP/AVP/TCP;unicast;interleaved=%d-%d\r\n"
+                "Session: %08X\r\n\r\n",
+                cseq, 
+                session->channel, 
+                session->channel + 1, 
+                0x11223344); 
+
+        *client_port = 0; 
+
+        return out; 
+    }
+
+    unsigned short dst_port = get_client_port(msg_rx); 
+
     // Format message. 
     snprintf(out, 
             RTSP_BUF_SIZE_MAX, 
@@ -265,8 +332,8 @@ static char * setup_handler(
             session->client_ip_str, 
             dst_port,
             dst_port+1, 
-            62000, 
-            62000+1, 
+            SX_MGMT_RTP_SERVER_PORT, 
+            SX_MGMT_RTP_SERVER_PORT + 1, 
             0x11223344); 
 
     *client_port = dst_port; 
@@ -353,23 +420,131 @@ static eRTSP_MSG get_msg_type(
 }
 
 
-// RTSP Server thread. 
-static void rtsp_server_thread(
-    void * arg
+// --------------------------------------------------------
+// ring_open
+//      Ring for the session's response writes, with its
+//      connection as a fixed file and its buffer registered. A
+//      ring per session keeps one slow client from holding up
+//      the others' responses. Without one, responses go with
+//      write().
+//
+static void ring_open(
+    unsigned int    id
     )
 {
-    unsigned int            id; 
-    unsigned int            addr_len;
-    struct sockaddr_in      client_addr;
-    char                    msg_rx[RTSP_BUF_SIZE_MAX]; 
-    char                   *msg_tx; 
-    unsigned short          client_port; 
-    uSX_MGMT_RTSP_EVENT_DATA   event_data; 
-    int                     rv; 
+    sMGMT_RTSP_SESSION *session;
+    struct iovec        iov;
+
+
+    session = &f_cblk.session[id];
+
+    session->ring = sx_uring_create(MGMT_RTSP_RING_LEN);
+    if(session->ring == NULL)
+    {
+        return;
+    }
+
+    iov.iov_base = f_cblk.tx_bufs[id];
+    iov.iov_len  = RTSP_BUF_SIZE_MAX;
+
+    if((sx_uring_files_register(session->ring, &session->tcp_sock, 1) != 0)
+       || (sx_uring_buffers_register(session->ring, &iov, 1) != 0))
+    {
+        logger_log("MGMT_RTSP: io_uring registration failed, using write() [errno = %d]", errno); 
+
+        sx_uring_destroy(session->ring);
+
+        session->ring = NULL;
+    }
+}
+
+
+// Drop the session's ring. It holds the connection open, so before
+// the connection is closed.
+static void ring_close(
+    unsigned int    id
+    )
+{
+    if(f_cblk.session[id].ring == NULL)
+    {
+        return;
+    }
+
+    sx_uring_destroy(f_cblk.session[id].ring);
+
+    f_cblk.session[id].ring = NULL;
+}
+
+
+// --------------------------------------------------------
+// response_send
+//      Write a response to the session's connection. With a
+//      ring it is copied to the session's registered buffer and
+//      written from there, the rest of a short or failed write
+//      goes with write(). If the ring fails the session goes on
+//      without it. Once RTP is interleaved on the connection, the
+//      RTP manager fits it in between packets.
+//
+static void response_send(
+    unsigned int    id,
+    const char     *msg
+    )
+{
+    sSX_URING_CQE   cqe;
+    unsigned int    len;
+    unsigned int    done;
+    unsigned char   queued;
+
+
+    len     = strlen(msg);
+    done    = 0;
+
+    if(f_cblk.session[id].playing)
+    {
+        // Between RTP packets, the RTP manager's writes to it. 
+        if(!sx_mgmt_rtp_interleave_write(id, msg, len))
+        {
+            logger_log("MGMT_RTSP: Response dropped, interleaved connection behind. [session ID = %d]", id); 
+        }
+
+        return; 
+    }
+
+    if(f_cblk.session[id].ring != NULL)
+    {
+        // Handlers print into RTSP_BUF_SIZE_MAX, it fits.
+        memcpy(f_cblk.tx_bufs[id], msg, len);
+
+        queued = sx_uring_write_fixed_queue(f_cblk.session[id].ring, 0, 0, f_cblk.tx_bufs[id], len, id);
+        assert(queued);
+
+        if(sx_uring_submit(f_cblk.session[id].ring, 1) == 1)
+        {
+            if((sx_uring_reap(f_cblk.session[id].ring, &cqe, 1) == 1) && (cqe.res > 0))
+            {
+                done = cqe.res;
+            }
+        }
+        else
+        {
+            logger_log("MGMT_RTSP: io_uring submit failed, back to write() [errno = %d]", errno); 
 
+            ring_close(id);
+        }
+    }
+
+    if(done < len)
+    {
+        write(f_cblk.session[id].tcp_sock, msg + done, len - done); 
+    }
+}
 
-    id = (unsigned int) arg; 
 
+// Log the new session's client.
+static void session_start(
+    unsigned int    id
+    )
+{
     sprintf(f_cblk.session[id].client_ip_str, 
             "%d.%d.%d.%d",
             ((unsigned char *) &f_cblk.session[id].client_ip)[0], 
@@ -377,136 +552,345 @@ static void rtsp_server_thread(
             ((unsigned char *) &f_cblk.session[id].client_ip)[2], 
             ((unsigned char *) &f_cblk.session[id].client_ip)[3]); 
 
-    logger_log("MGMT_RTSP: New RTSP server thread. [id = %d]", id); 
+    logger_log("MGMT_RTSP: New RTSP server instance. [id = %d]", id); 
 
     logger_log("MGMT_RTSP: Client IP: %s", f_cblk.session[id].client_ip_str); 
+}
 
-    while(1)
+
+// --------------------------------------------------------
+// frames_strip
+//      Take the '$' frames an interleaved client sends before and
+//      after requests out of what was read, passing RTCP on to the
+//      RTP manager. The body of a frame split across reads is
+//      skipped, a split header is kept until the rest of it comes.
+//
+//      Returns the bytes of request left, moved to the front of
+//      buf.
+//
+static unsigned int frames_strip(
+    unsigned int    id, 
+    char           *buf, 
+    unsigned int    len
+    )
+{
+    sMGMT_RTSP_SESSION     *session; 
+    unsigned char          *frame; 
+    unsigned int            frame_len; 
+    unsigned int            pos; 
+    unsigned int            out; 
+    char                   *end; 
+
+
+    session = &f_cblk.session[id]; 
+
+    pos = 0; 
+    out = 0; 
+
+    if(session->frame_hdr_len > 0)
     {
-        // Get received message. 
-        rv = read(f_cblk.session[id].tcp_sock, msg_rx, RTSP_BUF_SIZE_MAX); 
-        if(rv < 1)
+        while((session->frame_hdr_len < 4) && (pos < len))
         {
-            logger_log("MGMT_RTSP: Client terminated TCP connection. [client IP: %s]", 
-                    f_cblk.session[id].client_ip_str); 
-            break; 
+            session->frame_hdr[session->frame_hdr_len++] = buf[pos++]; 
         }
 
-        // Log request. 
-        logger_log("MGMT_RTSP: RTSP Request [session ID = %d]:", id); 
-        logger_log("%s", msg_rx); 
-
-        // Get message type. 
-        eRTSP_MSG msg_type = get_msg_type(msg_rx); 
-        switch(msg_type)
+        if(session->frame_hdr_len == 4)
         {
-            case RTSP_MSG_OPTIONS: 
-            {
-                msg_tx = options_handler(msg_rx); 
-                break; 
-            }
-            case RTSP_MSG_DESCRIBE:
-            {
-                msg_tx = describe_handler(&f_cblk.session[id], 
-                                          msg_rx); 
-                break; 
-            }
-            case RTSP_MSG_SETUP:
-            {
-                msg_tx = setup_handler(&f_cblk.session[id], 
-                        msg_rx, 
-                        &client_port); 
-                f_cblk.session[id].client_port = client_port; 
-                break; 
-            }
-            case RTSP_MSG_PLAY:
-            {
-                msg_tx = play_handler(msg_rx); 
-                break; 
-            }
-            case RTSP_MSG_TEARDOWN:
+            frame_len = (session->frame_hdr[2] << 8) | session->frame_hdr[3]; 
+
+            session->frame_hdr_len = 0; 
+
+            if(pos + frame_len <= len)
             {
-                msg_tx = teardown_handler(msg_rx); 
-                break; 
+                if(session->frame_hdr[1] == session->channel + 1)
+                {
+                    sx_mgmt_rtp_rtcp_input(session->client_ip, (unsigned char *) &buf[pos], frame_len); 
+                }
+
+                pos += frame_len; 
             }
-            default:
+            else
             {
-                // TODO: asserting on network data is never good. 
-                assert(0); 
+                session->frame_skip = frame_len; 
             }
         }
+    }
 
-        logger_log("MGMT_RTSP: RTSP Response [session ID = %d]:", id); 
-        logger_log("%s", msg_tx); 
+    frame_len = (session->frame_skip < len - pos) ? session->frame_skip : len - pos; 
 
-        // Send RTSP response. 
-        write(f_cblk.session[id].tcp_sock, msg_tx, strlen(msg_tx)); 
+    session->frame_skip -= frame_len; 
 
-        // Free sent message. 
-        free(msg_tx); 
+    pos += frame_len; 
 
-        // Perform appropriate callback. 
-        if(msg_type == RTSP_MSG_PLAY)
+    while(pos < len)
+    {
+        if(buf[pos] != '$')
         {
-            // Setup return data. 
-            event_data.play.id      = id; 
-            event_data.play.ip      = f_cblk.session[id].client_ip; 
-            event_data.play.port    = f_cblk.session[id].client_port; 
+            // A request, frames may follow its blank line. 
+            end = strstr(&buf[pos], "\r\n\r\n"); 
 
-            logger_log("####### "); 
+            frame_len = (end != NULL) ? end + 4 - &buf[pos] : len - pos; 
 
-            // Callback with event data. 
-            f_cblk.user_cback(f_cblk.user_arg, 
-                    MGMT_RTSP_EVENT_PLAY, 
-                    &event_data); 
+            memmove(&buf[out], &buf[pos], frame_len); 
+
+            out += frame_len; 
+            pos += frame_len; 
+
+            continue; 
+        }
+
+        frame = (unsigned char *) &buf[pos]; 
+
+        if(pos + 4 > len)
+        {
+            // The length is in the next read. 
+            session->frame_hdr_len = len - pos; 
+
+            memcpy(session->frame_hdr, frame, session->frame_hdr_len); 
+
+            break; 
+        }
+
+        frame_len = (frame[2] << 8) | frame[3]; 
+
+        if(pos + 4 + frame_len > len)
+        {
+            session->frame_skip = pos + 4 + frame_len - len; 
+
+            break; 
         }
 
-        if(msg_type == RTSP_MSG_TEARDOWN)
+        if(frame[1] == session->channel + 1)
         {
+            sx_mgmt_rtp_rtcp_input(session->client_ip, &frame[4], frame_len); 
+        }
+
+        pos += 4 + frame_len; 
+    }
+
+    buf[out] = 0; 
+
+    return out; 
+}
+
+
+// Stop RTP on the session's connection. 
+static void interleave_end(
+    unsigned int    id
+    )
+{
+    if(f_cblk.session[id].playing)
+    {
+        sx_mgmt_rtp_interleave_close(id); 
+    }
+
+    f_cblk.session[id].playing      = 0; 
+    f_cblk.session[id].interleaved  = 0; 
+}
+
+
+// --------------------------------------------------------
+// request_handle
+//      Read one request from the session's connection, answer
+//      it and report PLAY and TEARDOWN.
+//
+//      Returns 0 once the session is over, the caller then closes
+//      the connection and frees the session.
+//
+static unsigned char request_handle(
+    unsigned int    id
+    )
+{
+    char                    msg_rx[RTSP_BUF_SIZE_MAX]; 
+    char                   *msg_tx; 
+    unsigned short          client_port; 
+    uSX_MGMT_RTSP_EVENT_DATA   event_data; 
+    int                     rv; 
+
+
+    // Get received message. 
+    rv = read(f_cblk.session[id].tcp_sock, msg_rx, RTSP_BUF_SIZE_MAX - 1); 
+    if(rv < 1)
+    {
+        logger_log("MGMT_RTSP: Client terminated TCP connection. [client IP: %s]", 
+                f_cblk.session[id].client_ip_str); 
+
+        if(f_cblk.session[id].playing)
+        {
+            // The stream went with the connection. 
+            interleave_end(id); 
+
             event_data.teardown.id = id; 
 
-            // Callback with event data. 
             f_cblk.user_cback(f_cblk.user_arg, 
                     MGMT_RTSP_EVENT_TEARDOWN, 
                     &event_data); 
+        }
 
-            // Free resource.
-            session_instance_free(id);
+        return 0; 
+    }
+
+    msg_rx[rv] = 0; 
 
+    if(f_cblk.session[id].interleaved)
+    {
+        if(frames_strip(id, msg_rx, rv) == 0)
+        {
+            // Only RTCP. 
+            return 1; 
+        }
+    }
+
+    // Log request. 
+    logger_log("MGMT_RTSP: RTSP Request [session ID = %d]:", id); 
+    logger_log("%s", msg_rx); 
+
+    // Get message type. 
+    eRTSP_MSG msg_type = get_msg_type(msg_rx); 
+    switch(msg_type)
+    {
+        case RTSP_MSG_OPTIONS: 
+        {
+            msg_tx = options_handler(msg_rx); 
+            break; 
+        }
+        case RTSP_MSG_DESCRIBE:
+        {
+            msg_tx = describe_handler(&f_cblk.session[id], 
+                                      msg_rx); 
+            break; 
+        }
+        case RTSP_MSG_SETUP:
+        {
+            msg_tx = setup_handler(&f_cblk.session[id], 
+                    msg_rx, 
+                    &client_port); 
+            f_cblk.session[id].client_port = client_port; 
+            break; 
+        }
+        case RTSP_MSG_PLAY:
+        {
+            msg_tx = play_handler(msg_rx); 
+            break; 
+        }
+        case RTSP_MSG_TEARDOWN:
+        {
+            msg_tx = teardown_handler(msg_rx); 
             break; 
         }
+        default:
+        {
+            // TODO: asserting on network data is never good. 
+            assert(0); 
+        }
+    }
+
+    logger_log("MGMT_RTSP: RTSP Response [session ID = %d]:", id); 
+    logger_log("%s", msg_tx); 
+
+    // Send RTSP response. 
+    response_send(id, msg_tx); 
+
+    // Free sent message. 
+    free(msg_tx); 
+
+    if((msg_type == RTSP_MSG_PLAY) && f_cblk.session[id].interleaved && !f_cblk.session[id].playing)
+    {
+        // Packets follow the response on the connection. 
+        sx_mgmt_rtp_interleave_open(id, 
+                f_cblk.session[id].tcp_sock, 
+                f_cblk.session[id].channel); 
+
+        f_cblk.session[id].playing = 1; 
+    }
+
+    // Perform appropriate callback. 
+    if(msg_type == RTSP_MSG_PLAY)
+    {
+        // Setup return data. 
+        event_data.play.id      = id; 
+        event_data.play.ip      = f_cblk.session[id].client_ip; 
+        event_data.play.port    = f_cblk.session[id].client_port; 
+
+        logger_log("####### "); 
+
+        // Callback with event data. 
+        f_cblk.user_cback(f_cblk.user_arg, 
+                MGMT_RTSP_EVENT_PLAY, 
+                &event_data); 
     }
+
+    if(msg_type == RTSP_MSG_TEARDOWN)
+    {
+        interleave_end(id); 
+
+        event_data.teardown.id = id; 
+
+        // Callback with event data. 
+        f_cblk.user_cback(f_cblk.user_arg, 
+                MGMT_RTSP_EVENT_TEARDOWN, 
+                &event_data); 
+
+        return 0; 
+    }
+
+    return 1; 
 }
 
 
+// RTSP Server thread. 
+static void rtsp_server_thread(
+    void * arg
+    )
+{
+    unsigned int            id; 
+    int                     tcp_sock; 
 
 
+    id          = (unsigned int) (uintptr_t) arg; 
+    tcp_sock    = f_cblk.session[id].tcp_sock; 
+
+    session_start(id); 
+
+    while(request_handle(id))
+    {
+    }
+
+    ring_close(id); 
+
+    // An interleaved client waits for the end of the stream. 
+    close(tcp_sock); 
+
+    // Last, the listener hands the slot to the next connection. 
+    session_instance_free(id);
+}
+
 
 static void rtsp_thread_create(
     void   *arg
     )
 {
-    pthread_create(&f_cblk.session[(unsigned int) arg].rtsp_thread, NULL, (void *) &rtsp_server_thread, arg); 
+    pthread_create(&f_cblk.session[(unsigned int) (uintptr_t) arg].rtsp_thread, NULL, (void *) &rtsp_server_thread, arg); 
 }
 
 
-static void tcp_listener_thread(
-    void * arg
+// Create the listening socket. 
+static void listener_create(
+    void
     )
 {
-    unsigned int            addr_len;
     struct sockaddr_in      client_addr;
-    char                    msg_rx[RTSP_BUF_SIZE_MAX]; 
-    char                   *msg_tx; 
-    unsigned short          client_port; 
-    uSX_MGMT_RTSP_EVENT_DATA   event_data; 
-    int                     rv; 
 
 
     // Create socket. 
     f_cblk.rtsp_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     assert(f_cblk.rtsp_sock != -1);
 
+    // Closed sessions may leave the port in TIME_WAIT, don't let that
+    // stop a restart. 
+    int one = 1; 
+    setsockopt(f_cblk.rtsp_sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)); 
+
     // Setup address. 
     client_addr.sin_family      = AF_INET;
     client_addr.sin_port        = htons(MGMT_RTSP_PORT);
@@ -521,25 +905,51 @@ static void tcp_listener_thread(
 
     // Listening for traffic. 
     listen(f_cblk.rtsp_sock, 5); 
+}
 
-    while(1)
-    {
-        // Accept new TCP connection from specified address. 
-        int client_addr_len = sizeof(client_addr); 
-        int tcp_sock = accept(f_cblk.rtsp_sock, 
-                              (struct sockaddr *) &client_addr, 
-                              &client_addr_len); 
 
-        logger_log("MGMT_RTSP: Received new TCP connection, initiating new RTSP sever instance..."); 
+// Accept a TCP connection and give it a session, returns its id. 
+static unsigned int connection_accept(
+    void
+    )
+{
+    struct sockaddr_in      client_addr;
+
+
+    // Accept new TCP connection from specified address. 
+    int client_addr_len = sizeof(client_addr); 
+    int tcp_sock = accept(f_cblk.rtsp_sock, 
+                          (struct sockaddr *) &client_addr, 
+                          &client_addr_len); 
+
+    logger_log("MGMT_RTSP: Received new TCP connection, initiating new RTSP sever instance..."); 
 
-        // Allocate session instance. 
-        int session = session_instance_alloc(); 
+    // Allocate session instance. 
+    int session = session_instance_alloc(); 
 
-        f_cblk.session[session].client_ip   = client_addr.sin_addr.s_addr; 
-        f_cblk.session[session].tcp_sock    = tcp_sock; 
+    f_cblk.session[session].client_ip   = client_addr.sin_addr.s_addr; 
+    f_cblk.session[session].tcp_sock    = tcp_sock; 
+    f_cblk.session[session].interleaved = 0; 
+    f_cblk.session[session].playing     = 0; 
+    f_cblk.session[session].frame_skip  = 0; 
+    f_cblk.session[session].frame_hdr_len = 0; 
 
+    ring_open(session); 
+
+    return session; 
+}
+
+
+static void tcp_listener_thread(
+    void * arg
+    )
+{
+    listener_create(); 
+
+    while(1)
+    {
         // Create new TCP socket. 
-        rtsp_thread_create((void *) session); 
+        rtsp_thread_create((void *) (uintptr_t) connection_accept()); 
     }
 }
 
@@ -551,6 +961,48 @@ static void tcp_listener_create(
 }
 
 
+// Session connection readable, reactor thread. 
+static void session_cback(
+    void   *arg
+    )
+{
+    unsigned int    id; 
+    int             tcp_sock; 
+
+
+    id          = (unsigned int) (uintptr_t) arg; 
+    tcp_sock    = f_cblk.session[id].tcp_sock; 
+
+    if(!request_handle(id))
+    {
+        // Nobody reads it any more, as in a finished server thread. 
+        sx_reactor_fd_remove(tcp_sock); 
+
+        ring_close(id); 
+
+        close(tcp_sock); 
+
+        session_instance_free(id);
+    }
+}
+
+
+// Connection pending, reactor thread. 
+static void listener_cback(
+    void   *arg
+    )
+{
+    unsigned int    id; 
+
+
+    id = connection_accept(); 
+
+    session_start(id); 
+
+    sx_reactor_fd_add(f_cblk.session[id].tcp_sock, session_cback, (void *) (uintptr_t) id); 
+}
+
+
 void sx_mgmt_rtsp_init(
     fSX_MGMT_RTSP_CBACK    user_cback, 
     void               *user_arg
@@ -569,6 +1021,15 @@ void sx_mgmt_rtsp_open(
 {
     printf("mgmt_rtsp_open(): Inovked.\n"); 
 
+    if(sx_reactor_enabled())
+    {
+        listener_create(); 
+
+        sx_reactor_fd_add(f_cblk.rtsp_sock, listener_cback, NULL); 
+
+        return; 
+    }
+
     // Create RTSP thread. 
     tcp_listener_create(); 
 }
@@ -1,13 +1,15 @@
 #include "stdio.h"
-#include "fcntl.h"
-#include "mqueue.h"
+#include "pthread.h"
 #include "assert.h"
 
+#include "sx_mailbox.h"
+#include "sx_reactor.h"
 #include "sx_mgmt_rtsp.h"
 #include "sx_mgmt_rtp.h"
+#include "sx_mgmt_video.h"
 
 
-#define MGMT_SYS_MSG_QUEUE  "/mgmt_sys_msg_queue"
+#define MGMT_SYS_MAILBOX_LANE_SIZE  32
 
 
 typedef enum
@@ -53,7 +55,7 @@ typedef struct
 typedef struct
 {
     pthread_t       thread_id;
-    mqd_t           msg_queue;
+    SX_MAILBOX      mailbox;
     unsigned int    active_session; 
 
 } sMGMT_SYS_CBLK;
@@ -64,20 +66,8 @@ static void rerouces_init(
     void
     )
 {
-    struct mq_attr queue_attr;
-
-
-    // Set message attributes.
-    queue_attr.mq_flags     = 0;
-    queue_attr.mq_maxmsg    = 10;
-    queue_attr.mq_msgsize   = sizeof(sMGMT_SYS_MSG);
-    queue_attr.mq_curmsgs   = 0;
-
-    // Create message queue.
-    f_cblk.msg_queue = mq_open(MGMT_SYS_MSG_QUEUE,
-                               O_CREAT | O_RDWR,
-                               0644,
-                               &queue_attr);
+    // Create mailbox.
+    f_cblk.mailbox = sx_mailbox_create(sizeof(sMGMT_SYS_MSG), MGMT_SYS_MAILBOX_LANE_SIZE);
 }
 
 
@@ -97,10 +87,7 @@ static void mgmt_rtsp_cback(
         msg.event_data.play.ip = event_data->play.ip;
         msg.event_data.play.port = event_data->play.port;
 
-        mq_send(f_cblk.msg_queue,
-                (char *) &msg,
-                sizeof(sMGMT_SYS_MSG),
-                0);
+        sx_mailbox_send(f_cblk.mailbox, SX_MAILBOX_LANE_CONTROL, &msg);
     }
 
     if(event == MGMT_RTSP_EVENT_TEARDOWN)
@@ -108,21 +95,72 @@ static void mgmt_rtsp_cback(
         msg.event = MGMT_SYS_EVENT_TEARDOWN;
         msg.event_data.teardown.id = event_data->teardown.id; 
 
-        mq_send(f_cblk.msg_queue,
-                (char *) &msg,
-                sizeof(sMGMT_SYS_MSG),
-                0);
+        sx_mailbox_send(f_cblk.mailbox, SX_MAILBOX_LANE_CONTROL, &msg);
     }
 }
 
 
-static void mgmt_sys_thread(
-    void * arg
+// NAL units queued by the video manager, kick the RTP manager directly.
+static void mgmt_video_cback(
+    void   *arg
     )
 {
-    sMGMT_SYS_MSG   msg;
-    unsigned int    bytes_read;
+    sx_mgmt_rtp_service();
+}
+
+
+static void msg_handle(
+    sMGMT_SYS_MSG  *msg
+    )
+{
+    switch(msg->event)
+    {
+        case MGMT_SYS_EVENT_PLAY:
+        {
+            // Activate RTP manager.
+            sx_mgmt_rtp_activate(msg->event_data.play.id,
+                                 msg->event_data.play.ip,
+                                 msg->event_data.play.port);
+
+            if(f_cblk.active_session == 0)
+            {
+                logger_log("mgmt_video_activate() Invoked");
+
+                sx_mgmt_video_activate(); 
+            }
 
+            f_cblk.active_session++; 
+
+            break;
+        }
+        case MGMT_SYS_EVENT_TEARDOWN:
+        {
+            // Reset associate RTP session. 
+            sx_mgmt_rtp_reset(msg->event_data.teardown.id); 
+
+            f_cblk.active_session--; 
+
+            if(f_cblk.active_session == 0)
+            {
+                logger_log("mgmt_video_reset() Invoked");
+
+                sx_mgmt_video_reset(); 
+            }
+            break; 
+        }
+        default:
+        {
+            assert(0);
+        }
+    }
+}
+
+
+// Open the managers, they start their threads or register with the reactor.
+static void managers_open(
+    void
+    )
+{
     // Open RTSP manager.
     sx_mgmt_rtsp_open();
 
@@ -131,55 +169,38 @@ static void mgmt_sys_thread(
 
     // Open video manager. 
     sx_mgmt_video_open(); 
+}
 
-    while(1)
-    {
-        bytes_read = mq_receive(f_cblk.msg_queue,
-                                (char *) &msg,
-                                sizeof(sMGMT_SYS_MSG),
-                                NULL);
-        assert(bytes_read > 0);
 
-        switch(msg.event)
-        {
-            case MGMT_SYS_EVENT_PLAY:
-            {
-                // Activate RTP manager.
-                sx_mgmt_rtp_activate(msg.event_data.play.id,
-                                     msg.event_data.play.ip,
-                                     msg.event_data.play.port);
+static void mgmt_sys_thread(
+    void * arg
+    )
+{
+    sMGMT_SYS_MSG   msg;
 
-                if(f_cblk.active_session == 0)
-                {
-                    logger_log("mgmt_video_activate() Invoked");
 
-                    sx_mgmt_video_activate(); 
-                }
+    managers_open();
 
-                f_cblk.active_session++; 
+    while(1)
+    {
+        sx_mailbox_recv(f_cblk.mailbox, &msg);
 
-                break;
-            }
-            case MGMT_SYS_EVENT_TEARDOWN:
-            {
-                // Reset associate RTP session. 
-                sx_mgmt_rtp_reset(msg.event_data.teardown.id); 
+        msg_handle(&msg);
+    }
+}
 
-                f_cblk.active_session--; 
 
-                if(f_cblk.active_session == 0)
-                {
-                    logger_log("mgmt_video_reset() Invoked");
+// Mailbox readable, reactor thread.
+static void mailbox_cback(
+    void   *arg
+    )
+{
+    sMGMT_SYS_MSG   msg;
 
-                    sx_mgmt_video_reset(); 
-                }
-                break; 
-            }
-            default:
-            {
-                assert(0);
-            }
-        }
+
+    while(sx_mailbox_poll(f_cblk.mailbox, &msg))
+    {
+        msg_handle(&msg);
     }
 }
 
@@ -206,7 +227,7 @@ void mgmt_sys_init(
     sx_mgmt_rtp_init();
 
     // Initialize video manager. 
-    sx_mgmt_video_init(); 
+    sx_mgmt_video_init(mgmt_video_cback, &f_cblk); 
 }
 
 
@@ -215,6 +236,18 @@ void mgmt_sys_open(
 {
     printf("mgmt_sys_open(): Invoked.\n"); 
 
+    if(sx_reactor_enabled())
+    {
+        // Everything runs from here on this thread.
+        sx_reactor_mailbox_add(f_cblk.mailbox, mailbox_cback, NULL);
+
+        managers_open();
+
+        sx_reactor_run();
+
+        return;
+    }
+
     mgmt_sys_thread_create();
 
     pthread_join(f_cblk.thread_id, NULL);
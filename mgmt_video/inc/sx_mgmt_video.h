@@ -1,17 +1,54 @@
 
-#define NAL_UNIT_SIZE_MAX   (65536*2)
+#include "sx_seg.h"
+#include "sx_queue.h"
+
+// NAL units queued for the RTP manager by default.
+#define SX_MGMT_VIDEO_QUEUE_LEN     64
 
 
 typedef struct
 {
-    unsigned char   nal_unit[NAL_UNIT_SIZE_MAX]; 
-    unsigned int    nal_unit_len; 
+    unsigned char  *nal_unit;       ///< NAL unit start, in the first segment. 
+    unsigned int    nal_unit_len;   ///< NAL unit length, all segments. 
+    const sSX_SEG  *seg;            ///< Payload segment chain. 
+    void           *hw_buf;         ///< Camera buffer backing nal_unit, NULL if owned. 
+    unsigned char   flags;          ///< Access unit boundaries, SX_NAL_FLAG_xxx. 
+    unsigned long long pts;         ///< Capture time (us, sx_clock_mono_us() timebase). 
+    int             ref_count;      ///< References held, freed with the last one. 
+    sSX_SEG         data_seg;       ///< Segment over data, owned copies only. 
+    unsigned char   data[];         ///< Owned copy of the payload. 
 
 } sMGMT_VIDEO_NAL_UNIT; 
 
 
+typedef struct
+{
+    unsigned int        queue_len;      ///< NAL units queued for RTP at most, 0 = unbounded. 
+    eSX_QUEUE_POLICY    queue_policy;   ///< What a full queue does with the next NAL unit. 
+
+} sSX_MGMT_VIDEO_CONFIG; 
+
+
+// Invoked on the video manager thread after NAL units were queued for
+// sx_mgmt_video_get_nal_unit().
+typedef void (*fSX_MGMT_VIDEO_CBACK) (
+    void   *arg
+);
+
+
+extern void sx_mgmt_video_config_get(
+    sSX_MGMT_VIDEO_CONFIG          *config
+    ); 
+
+
+extern void sx_mgmt_video_config_set(
+    const sSX_MGMT_VIDEO_CONFIG    *config
+    ); 
+
+
 extern void sx_mgmt_video_init(
-    void
+    fSX_MGMT_VIDEO_CBACK    user_cback, 
+    void                   *user_arg
     ); 
 
 
@@ -45,11 +82,27 @@ extern sMGMT_VIDEO_NAL_UNIT * sx_mgmt_video_get_nal_unit(
     ); 
 
 
+extern void sx_mgmt_video_keyframe_request(
+    void
+    ); 
+
+
+extern unsigned int sx_mgmt_video_get_nal_units(
+    sMGMT_VIDEO_NAL_UNIT  **nal_units, 
+    unsigned int            count_max
+    ); 
+
+
 extern unsigned char sx_mgmt_video_is_key_frame(
     sMGMT_VIDEO_NAL_UNIT   *nal_unit
     ); 
 
 
+extern sMGMT_VIDEO_NAL_UNIT * sx_mgmt_video_nal_unit_ref(
+    sMGMT_VIDEO_NAL_UNIT   *nal_unit
+    ); 
+
+
 extern void sx_mgmt_video_free_nal_unit(
     sMGMT_VIDEO_NAL_UNIT   *nal_unit
     ); 
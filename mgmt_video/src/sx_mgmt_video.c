@@ -1,15 +1,24 @@
 #include <stdio.h> 
 #include <stdlib.h> 
+#include <string.h> 
 #include "logger.h"
 #include "pthread.h"
-#include "mqueue.h"
+#include "sched.h"
 #include "assert.h"
 
+#include "sx_mailbox.h"
+#include "sx_reactor.h"
 #include "sx_queue.h"
+#include "sx_slab.h"
 #include "sx_mgmt_video.h"
 #include "sx_mgmt_camera_hw.h"
+#include "sx_nal_scan.h"
 
-#define MGMT_VIDEO_MSG_QUEUE  "/mgmt_video_msg_queue"
+// Messages per mailbox lane, SERVICE is coalesced to one in flight.
+#define MGMT_VIDEO_MAILBOX_LANE_SIZE    16
+
+// Camera NAL units taken per SERVICE message before control messages get a turn. 
+#define MGMT_VIDEO_SERVICE_BATCH    64
 
 typedef enum 
 {
@@ -21,18 +30,21 @@ typedef enum
 
 typedef struct
 {
-    pthread_mutex_t         pps_mutex;      ///< NAL unit chain mutex.
-    pthread_mutex_t         sps_mutex;      ///< NAL unit chain mutex.
-
-    sMGMT_VIDEO_NAL_UNIT   *pps_nal_unit;   ///< Current PPS NAL unit.
-    sMGMT_VIDEO_NAL_UNIT   *sps_nal_unit;   ///< Current SPS NAL unit.
+    sMGMT_VIDEO_NAL_UNIT   *pps_nal_unit;   ///< Current PPS NAL unit, swapped atomically.
+    sMGMT_VIDEO_NAL_UNIT   *sps_nal_unit;   ///< Current SPS NAL unit, swapped atomically.
+    int                     ps_readers;     ///< Parameter set gets in progress.
 
     pthread_t               thread_id;      ///< Thread ID.
-    mqd_t                   msg_queue;      ///< Message queue.
+    SX_MAILBOX              mailbox;        ///< Control and service messages.
 
     eMGMT_VIDEO_STATE       state;          ///< State
 
-    SX_QUEUE               nal_unit_queue;
+    sSX_MGMT_VIDEO_CONFIG   config;         ///< Queue configuration.
+    SX_QUEUE                nal_unit_queue; ///< NAL units for the RTP manager.
+
+    volatile int            service_pending;///< SERVICE message in flight.
+    fSX_MGMT_VIDEO_CBACK    user_cback;     ///< NAL units queued callback.
+    void                   *user_arg;       ///< Callback argument.
 
 } sMGMT_VIDEO_CBLK; 
 
@@ -53,16 +65,8 @@ typedef struct
 } sMGMT_SYS_EVENT_DATA_ACTIVATE; 
 
 
-typedef struct
-{
-    sMGMT_VIDEO_NAL_UNIT   *nal_unit; 
-
-} sMGMT_SYS_EVENT_DATA_SERVICE; 
-
-
 typedef union
 {
-    sMGMT_SYS_EVENT_DATA_SERVICE    service; 
     sMGMT_SYS_EVENT_DATA_ACTIVATE   activate; 
 
 } uMGMT_VIDEO_EVENT_DATA; 
@@ -77,7 +81,47 @@ typedef struct
 
 
 // Video manager control block. 
-static sMGMT_VIDEO_CBLK f_cblk; 
+static sMGMT_VIDEO_CBLK f_cblk = 
+{
+    .config = 
+    {
+        .queue_len      = SX_MGMT_VIDEO_QUEUE_LEN, 
+        .queue_policy   = SX_QUEUE_POLICY_DROP_TO_KEY, 
+    },
+}; 
+
+
+// NAL unit dropped by a full queue. 
+static void queue_drop(
+    void   *arg, 
+    void   *data
+    )
+{
+    sx_mgmt_video_free_nal_unit(data); 
+}
+
+
+// Queue emptied with nothing to resume from, don't wait out the GOP. 
+static void queue_flush(
+    void   *arg
+    )
+{
+    sx_mgmt_video_keyframe_request(); 
+}
+
+
+static unsigned char queue_is_key(
+    void   *arg, 
+    void   *data
+    )
+{
+    sMGMT_VIDEO_NAL_UNIT   *nal_unit; 
+
+
+    nal_unit = data; 
+
+    return sx_camera_hw_is_key(nal_unit->nal_unit, nal_unit->nal_unit_len, nal_unit->flags); 
+}
 
 
 // Initialize relevant system resources. 
@@ -85,28 +129,141 @@ static void resources_init(
     void
     )
 {
-    struct mq_attr queue_attr;
+    sSX_QUEUE_CONFIG    queue_config;
+
+
+    // Create mailbox.
+    f_cblk.mailbox = sx_mailbox_create(sizeof(sMGMT_VIDEO_MSG), MGMT_VIDEO_MAILBOX_LANE_SIZE);
+
+    queue_config.capacity   = f_cblk.config.queue_len;
+    queue_config.policy     = f_cblk.config.queue_policy;
+
+    if(sx_reactor_enabled() && (queue_config.policy == SX_QUEUE_POLICY_BLOCK))
+    {
+        // The RTP manager drains it on this same thread, blocking here
+        // would never end. The camera queue still holds the source back. 
+        queue_config.capacity = 0; 
+
+        logger_log("(mgmt_video): Reactor mode, RTP queue unbounded instead of blocking."); 
+    }
+    queue_config.drop       = queue_drop;
+    queue_config.is_key     = queue_is_key;
+    queue_config.flush      = queue_flush;
+    queue_config.user_arg   = NULL;
+
+    f_cblk.nal_unit_queue = sx_queue_create_bounded(&queue_config);
+}
+
+
+// Copy a NAL unit into owned memory, so cached units never pin camera buffers. 
+// Descriptor and payload share one slab block, the payload in one segment. 
+static sMGMT_VIDEO_NAL_UNIT * nal_unit_dup(
+    sMGMT_VIDEO_NAL_UNIT   *src
+    )
+{
+    sMGMT_VIDEO_NAL_UNIT   *nal_unit; 
+    sSX_SEG_CURSOR          cursor; 
+
+
+    nal_unit = sx_slab_alloc(sizeof(sMGMT_VIDEO_NAL_UNIT) + src->nal_unit_len); 
+
+    sx_seg_init(&nal_unit->data_seg, nal_unit->data, src->nal_unit_len); 
+
+    sx_seg_cursor_init(&cursor, src->seg); 
+
+    nal_unit->data_seg.len  = sx_seg_read(&cursor, nal_unit->data, src->nal_unit_len); 
+
+    nal_unit->nal_unit      = nal_unit->data; 
+    nal_unit->nal_unit_len  = src->nal_unit_len; 
+    nal_unit->seg           = &nal_unit->data_seg; 
+    nal_unit->hw_buf        = NULL; 
+    nal_unit->flags         = src->flags; 
+    nal_unit->pts           = src->pts; 
+    nal_unit->ref_count     = 1; 
+
+    return nal_unit; 
+}
+
+
+// --------------------------------------------------------
+// param_set_publish
+//      Replace the parameter set in slot with a copy of nal_unit.
+//      Video manager thread only.
+//
+//      A reader that loaded the old pointer holds ps_readers up
+//      until it has taken its reference, so once ps_readers reads
+//      0 after the swap only reference holders can reach the old
+//      copy and ours can be dropped.
+//
+static void param_set_publish(
+    sMGMT_VIDEO_NAL_UNIT  **slot, 
+    sMGMT_VIDEO_NAL_UNIT   *nal_unit
+    )
+{
+    sMGMT_VIDEO_NAL_UNIT   *old; 
+
+
+    // Own copy, a cached parameter set must not pin a camera buffer. 
+    old = __atomic_exchange_n(slot, nal_unit_dup(nal_unit), __ATOMIC_SEQ_CST); 
+    if(old == NULL)
+    {
+        return; 
+    }
 
+    // Grace period, readers only hold it for a load and an increment. 
+    while(__atomic_load_n(&f_cblk.ps_readers, __ATOMIC_SEQ_CST) != 0)
+    {
+        sched_yield(); 
+    }
 
-    // Set message attributes.
-    queue_attr.mq_flags     = 0;
-    queue_attr.mq_maxmsg    = 10;
-    queue_attr.mq_msgsize   = sizeof(sMGMT_VIDEO_MSG);
-    queue_attr.mq_curmsgs   = 0;
+    sx_mgmt_video_free_nal_unit(old); 
+}
 
-    // Create message queue.
-    f_cblk.msg_queue = mq_open(MGMT_VIDEO_MSG_QUEUE,
-                               O_CREAT | O_RDWR,
-                               0644,
-                               &queue_attr);
 
-    // Initialize mutex. 
-    pthread_mutex_init(&f_cblk.pps_mutex, NULL); 
+// Reference the parameter set in slot, NULL if none seen yet. 
+static sMGMT_VIDEO_NAL_UNIT * param_set_get(
+    sMGMT_VIDEO_NAL_UNIT  **slot
+    )
+{
+    sMGMT_VIDEO_NAL_UNIT   *nal_unit; 
 
-    // Initialize mutex. 
-    pthread_mutex_init(&f_cblk.sps_mutex, NULL); 
 
-    f_cblk.nal_unit_queue = sx_queue_create();
+    __atomic_add_fetch(&f_cblk.ps_readers, 1, __ATOMIC_SEQ_CST); 
+
+    nal_unit = __atomic_load_n(slot, __ATOMIC_SEQ_CST); 
+    if(nal_unit != NULL)
+    {
+        sx_mgmt_video_nal_unit_ref(nal_unit); 
+    }
+
+    __atomic_sub_fetch(&f_cblk.ps_readers, 1, __ATOMIC_RELEASE); 
+
+    return nal_unit; 
+}
+
+
+// Keep the latest SPS/PPS for sessions joining mid-stream. 
+static void param_set_cache(
+    sMGMT_VIDEO_NAL_UNIT   *nal_unit
+    )
+{
+    switch(nal_unit->nal_unit[0] & 0x1F)
+    {
+        case 0x07:
+        {
+            param_set_publish(&f_cblk.sps_nal_unit, nal_unit); 
+            break; 
+        }
+        case 0x08:
+        {
+            param_set_publish(&f_cblk.pps_nal_unit, nal_unit); 
+            break; 
+        }
+        default:
+        {
+            break; 
+        }
+    }
 }
 
 
@@ -119,58 +276,86 @@ void idle_state_activate_event_handler(
 }
 
 
-static void active_state_service_event_handler(
-    sMGMT_VIDEO_MSG    *msg
+static void active_state_nal_unit_handler(
+    sMGMT_VIDEO_NAL_UNIT   *nal_unit
     )
 {
-    sx_queue_push(f_cblk.nal_unit_queue, msg->event_data.service.nal_unit);
+    param_set_cache(nal_unit); 
+
+    sx_queue_push(f_cblk.nal_unit_queue, nal_unit);
 }
 
 
-static void idle_state_service_event_handler(
-    sMGMT_VIDEO_MSG    *msg
+static void idle_state_nal_unit_handler(
+    sMGMT_VIDEO_NAL_UNIT   *nal_unit
     )
 {
-    if((msg->event_data.service.nal_unit->nal_unit[0] & 0x1F) == 0x07)
-    {
-        // Cache SPS. 
-        logger_log("MGMT_VIDEO:: New SPS NAL unit"); 
+    param_set_cache(nal_unit); 
 
-        // Lock mutex. 
-        pthread_mutex_lock(&f_cblk.sps_mutex); 
+    sx_mgmt_video_free_nal_unit(nal_unit); 
+}
 
-        if(f_cblk.sps_nal_unit != NULL)
-        {
-            free(f_cblk.sps_nal_unit); 
-        }
 
-        // Free mutex. 
-        f_cblk.sps_nal_unit = msg->event_data.service.nal_unit; 
+static void camera_hw_cback(
+    void   *arg
+    ); 
 
-        logger_log("MGMT_VIDEO:: New SPS NAL unit len %d", f_cblk.sps_nal_unit->nal_unit_len); 
 
-        pthread_mutex_unlock(&f_cblk.sps_mutex); 
-    }
-    else if((msg->event_data.service.nal_unit->nal_unit[0] & 0x1F) == 0x08)
+// Drain the NAL units the camera has ready. 
+static void service_event_handler(
+    void
+    )
+{
+    sSX_CAMERA_HW_BUFFER   *hw_bufs[MGMT_VIDEO_SERVICE_BATCH];
+    sSX_CAMERA_HW_BUFFER   *hw_buf;
+    sMGMT_VIDEO_NAL_UNIT   *nal_unit;
+    unsigned int            count;
+    unsigned int            i;
+
+
+    // Re-arm the camera notification before draining so no arrival is missed. 
+    __sync_fetch_and_and(&f_cblk.service_pending, 0);
+
+    // One queue lock for the whole batch. 
+    count = sx_camera_hw_get_many(hw_bufs, MGMT_VIDEO_SERVICE_BATCH); 
+
+    for(i = 0; i < count; i++)
     {
-        // Cache PPS. 
-        logger_log("MGMT_VIDEO:: New PPS NAL unit"); 
+        hw_buf = hw_bufs[i]; 
+
+        // Describe the camera buffer in place, no payload copy. 
+        nal_unit = sx_slab_alloc(sizeof(sMGMT_VIDEO_NAL_UNIT));
 
-        pthread_mutex_lock(&f_cblk.pps_mutex); 
+        nal_unit->nal_unit      = hw_buf->seg.data;
+        nal_unit->nal_unit_len  = hw_buf->nal_len;
+        nal_unit->seg           = &hw_buf->seg;
+        nal_unit->hw_buf        = hw_buf;
+        nal_unit->flags         = hw_buf->flags;
+        nal_unit->pts           = hw_buf->pts;
+        nal_unit->ref_count     = 1;
 
-        if(f_cblk.pps_nal_unit != NULL)
+        if(f_cblk.state == MGMT_VIDEO_STATE_ACTIVE)
         {
-            free(f_cblk.pps_nal_unit); 
+            active_state_nal_unit_handler(nal_unit);
+
+            // Hand off to the consumer per unit, not per burst. Everything
+            // queued is then always notified, so a full queue blocking the
+            // next push drains. The consumer coalesces notifications. 
+            if(f_cblk.user_cback != NULL)
+            {
+                f_cblk.user_cback(f_cblk.user_arg);
+            }
+        }
+        else
+        {
+            idle_state_nal_unit_handler(nal_unit);
         }
-
-        pthread_mutex_unlock(&f_cblk.pps_mutex); 
-
-        f_cblk.pps_nal_unit = msg->event_data.service.nal_unit;
     }
-    else
+
+    if(count == MGMT_VIDEO_SERVICE_BATCH)
     {
-        // Free unit. 
-        free(msg->event_data.service.nal_unit); 
+        // More may be waiting, continue after any control message. 
+        camera_hw_cback(NULL); 
     }
 }
 
@@ -190,7 +375,20 @@ static void active_state_reset_event_handler(
             break;
         }
 
-        free(nal_unit);
+        sx_mgmt_video_free_nal_unit(nal_unit);
+    }
+
+    sx_slab_stats_log();
+
+    sx_camera_hw_stats_log();
+
+    sx_queue_stats_log(f_cblk.nal_unit_queue, "mgmt_video");
+
+    sx_mailbox_stats_log(f_cblk.mailbox, "mgmt_video");
+
+    if(sx_reactor_enabled())
+    {
+        sx_reactor_stats_log(); 
     }
 
     f_cblk.state = MGMT_VIDEO_STATE_INIT; 
@@ -205,10 +403,7 @@ static void idle_state_handler(
     {
         case MGMT_VIDEO_EVENT_SERVICE:
         {
-//            logger_log("(idle_state_handler): msg->event_data.service.nal_unit = 0x%x",
-//                       msg->event_data.service.nal_unit);
-            
-            idle_state_service_event_handler(msg);
+            service_event_handler();
             break;
         }
         case MGMT_VIDEO_EVENT_ACTIVATE:
@@ -232,7 +427,7 @@ static void active_state_handler(
     {
         case MGMT_VIDEO_EVENT_SERVICE:
             
-            active_state_service_event_handler(msg); 
+            service_event_handler(); 
             break;
 
         case MGMT_VIDEO_EVENT_ACTIVATE:
@@ -249,72 +444,74 @@ static void active_state_handler(
 }
 
 
+static void msg_handle(
+    sMGMT_VIDEO_MSG    *msg
+    )
+{
+    switch(f_cblk.state)
+    {
+        case MGMT_VIDEO_STATE_INIT:
+            idle_state_handler(msg); 
+            break; 
+
+        case MGMT_VIDEO_STATE_ACTIVE:
+            active_state_handler(msg); 
+            break; 
+
+        default: 
+            break; 
+    }
+}
+
+
 static void mgmt_video_thread(
     void * arg
     )
 {
     sMGMT_VIDEO_MSG msg; 
-    unsigned int    bytes_read; 
 
 
     while(1)
     {
-        bytes_read = mq_receive(f_cblk.msg_queue,
-                                (char *) &msg,
-                                sizeof(sMGMT_VIDEO_MSG),
-                                NULL);
-        assert(bytes_read > 0);
-
-        switch(f_cblk.state)
-        {
-            case MGMT_VIDEO_STATE_INIT:
-                idle_state_handler(&msg); 
-                break; 
+        sx_mailbox_recv(f_cblk.mailbox, &msg);
 
-            case MGMT_VIDEO_STATE_ACTIVE:
-                active_state_handler(&msg); 
-                break; 
-
-            default: 
-                break; 
-        }
+        msg_handle(&msg); 
     }
 }
 
 
-static void video_capture_thread(
-    void *arg 
+// Mailbox readable, reactor thread. 
+static void mailbox_cback(
+    void   *arg
     )
 {
-    int                     status;
-    unsigned int            index;
-    unsigned int            curr_dword;
-    unsigned char           temp;
-    sMGMT_VIDEO_MSG         msg;
-    sMGMT_VIDEO_NAL_UNIT   *nal_unit; 
-    unsigned char           file_end; 
+    sMGMT_VIDEO_MSG msg; 
 
 
-    while(1)
+    while(sx_mailbox_poll(f_cblk.mailbox, &msg))
     {
-        sSX_CAMERA_HW_BUFFER * hw_buf;
-        do
-        {
-            usleep(5*1000);
+        msg_handle(&msg); 
+    }
+}
 
-            hw_buf = sx_camera_hw_get();
 
-        } while (hw_buf == NULL);
+// Camera NAL unit ready callback, runs on the camera source thread. 
+static void camera_hw_cback(
+    void   *arg
+    )
+{
+    sMGMT_VIDEO_MSG msg;
 
-        // Construct and queue service event.
-        msg.event                       = MGMT_VIDEO_EVENT_SERVICE;
-        msg.event_data.service.nal_unit = (sMGMT_VIDEO_NAL_UNIT *) hw_buf;
 
-        mq_send(f_cblk.msg_queue,
-                (char *) &msg,
-                sizeof(sMGMT_VIDEO_MSG),
-                0);
+    // One SERVICE message in flight is enough, the handler drains everything. 
+    if(__sync_lock_test_and_set(&f_cblk.service_pending, 1))
+    {
+        return;
     }
+
+    msg.event = MGMT_VIDEO_EVENT_SERVICE;
+
+    sx_mailbox_send(f_cblk.mailbox, SX_MAILBOX_LANE_DATA, &msg);
 }
 
 
@@ -326,20 +523,40 @@ static void mgmt_video_thread_create(
 }
 
 
-static void video_capture_thread_create(
-    void
+// --------------------------------------------------------
+// sx_mgmt_video_config_get
+//      Get the current (initially default) configuration.
+//
+void sx_mgmt_video_config_get(
+    sSX_MGMT_VIDEO_CONFIG          *config
     )
 {
-    pthread_create(&f_cblk.thread_id, NULL, (void *) &video_capture_thread, NULL);
+    *config = f_cblk.config; 
+}
+
+
+// --------------------------------------------------------
+// sx_mgmt_video_config_set
+//      Must be called before sx_mgmt_video_init().
+//
+void sx_mgmt_video_config_set(
+    const sSX_MGMT_VIDEO_CONFIG    *config
+    )
+{
+    f_cblk.config = *config; 
 }
 
 
 void sx_mgmt_video_init(
-    void
+    fSX_MGMT_VIDEO_CBACK    user_cback, 
+    void                   *user_arg
     )
 {
     logger_log("(mgmt_video_init): Invoked."); 
 
+    // Cache user callback. 
+    f_cblk.user_cback   = user_cback; 
+    f_cblk.user_arg     = user_arg; 
 
     // Initialize resources. 
     resources_init(); 
@@ -352,13 +569,18 @@ void sx_mgmt_video_open(
 {
     logger_log("(mgmt_video_open): Invoked."); 
 
-    // Create video manager thread. 
-    mgmt_video_thread_create(); 
-
-    // Create video capturer thread. 
-    video_capture_thread_create();
+    if(sx_reactor_enabled())
+    {
+        sx_reactor_mailbox_add(f_cblk.mailbox, mailbox_cback, NULL); 
+    }
+    else
+    {
+        // Create video manager thread. 
+        mgmt_video_thread_create(); 
+    }
 
-    sx_camera_hw_open();
+    // Camera notifies the video manager as NAL units arrive. 
+    sx_camera_hw_open(camera_hw_cback, NULL);
 }
 
 
@@ -373,10 +595,7 @@ void sx_mgmt_video_activate(
 
     msg.event = MGMT_VIDEO_EVENT_ACTIVATE; 
 
-    mq_send(f_cblk.msg_queue,
-            (char *) &msg,
-            sizeof(sMGMT_VIDEO_MSG),
-            0);
+    sx_mailbox_send(f_cblk.mailbox, SX_MAILBOX_LANE_CONTROL, &msg);
 }
 
 
@@ -391,10 +610,20 @@ void sx_mgmt_video_reset(
 
     msg.event = MGMT_VIDEO_EVENT_RESET; 
 
-    mq_send(f_cblk.msg_queue,
-            (char *) &msg,
-            sizeof(sMGMT_VIDEO_MSG),
-            0);
+    sx_mailbox_send(f_cblk.mailbox, SX_MAILBOX_LANE_CONTROL, &msg);
+}
+
+
+// --------------------------------------------------------
+// sx_mgmt_video_keyframe_request
+//      A receiver needs an IDR to start or resync decoding. Safe
+//      from any thread, concurrent requests share one IDR.
+//
+void sx_mgmt_video_keyframe_request(
+    void
+    )
+{
+    sx_camera_hw_keyframe_request(); 
 }
 
 
@@ -411,83 +640,86 @@ unsigned char sx_mgmt_video_is_key_frame(
 }
 
 
+// --------------------------------------------------------
+// sx_mgmt_video_pps_get
+//      Reference the current PPS, NULL if none seen yet. Lock-free,
+//      drop the reference with sx_mgmt_video_free_nal_unit().
+//
 sMGMT_VIDEO_NAL_UNIT * sx_mgmt_video_pps_get(
     void
     )
 {
-    sMGMT_VIDEO_NAL_UNIT       *nal_unit; 
-
-
-    logger_log("(mgmt_video_get_pps_nal_unit): Invoked.\n");
-
-    // Mutex lock. 
-    pthread_mutex_lock(&f_cblk.pps_mutex); 
-
-    if(f_cblk.pps_nal_unit == NULL) 
-    {
-        nal_unit = NULL; 
-
-        goto cleanup; 
-    }
-
-    nal_unit = malloc(sizeof(sMGMT_VIDEO_NAL_UNIT)); 
-
-    // Copy PPS NAL unit. 
-    *nal_unit = *f_cblk.pps_nal_unit; 
-
-cleanup:
-    // Mutex unlock. 
-    pthread_mutex_unlock(&f_cblk.pps_mutex); 
-
-    return nal_unit; 
+    return param_set_get(&f_cblk.pps_nal_unit); 
 }
 
 
+// --------------------------------------------------------
+// sx_mgmt_video_sps_get
+//      Reference the current SPS, NULL if none seen yet. Lock-free,
+//      drop the reference with sx_mgmt_video_free_nal_unit().
+//
 sMGMT_VIDEO_NAL_UNIT * sx_mgmt_video_sps_get(
     void
     )
 {
-    sMGMT_VIDEO_NAL_UNIT   *nal_unit; 
-
-
-    logger_log("mgmt_video_get_sps_nal_unit(): Invoked.\n"); 
-
-    // Mutex lock. 
-    pthread_mutex_lock(&f_cblk.sps_mutex); 
-
-    if(f_cblk.sps_nal_unit == NULL) 
-    {
-        nal_unit = NULL; 
-
-        goto cleanup; 
-    }
-
-    nal_unit = malloc(sizeof(sMGMT_VIDEO_NAL_UNIT)); 
+    return param_set_get(&f_cblk.sps_nal_unit); 
+}
 
-    // Copy PPS NAL unit. 
-    *nal_unit = *f_cblk.sps_nal_unit; 
 
-    logger_log("nal unit %d", nal_unit->nal_unit_len); 
+sMGMT_VIDEO_NAL_UNIT * sx_mgmt_video_get_nal_unit(
+    void
+    )
+{
+    return sx_queue_pull(f_cblk.nal_unit_queue);
+}
 
-cleanup:
-    // Mutex unlock. 
-    pthread_mutex_unlock(&f_cblk.sps_mutex); 
 
-    return nal_unit; 
+// --------------------------------------------------------
+// sx_mgmt_video_get_nal_units
+//      Take up to count_max queued NAL units in one go.
+//
+unsigned int sx_mgmt_video_get_nal_units(
+    sMGMT_VIDEO_NAL_UNIT  **nal_units, 
+    unsigned int            count_max
+    )
+{
+    return sx_queue_pull_many(f_cblk.nal_unit_queue, (void **) nal_units, count_max);
 }
-    
 
-sMGMT_VIDEO_NAL_UNIT * sx_mgmt_video_get_nal_unit(
-    void
+
+// --------------------------------------------------------
+// sx_mgmt_video_nal_unit_ref
+//      Take another reference, for a second consumer of the same
+//      NAL unit. NAL units are immutable once queued.
+//
+sMGMT_VIDEO_NAL_UNIT * sx_mgmt_video_nal_unit_ref(
+    sMGMT_VIDEO_NAL_UNIT   *nal_unit
     )
 {
-    return sx_queue_pull(f_cblk.nal_unit_queue);
+    __atomic_add_fetch(&nal_unit->ref_count, 1, __ATOMIC_RELAXED); 
+
+    return nal_unit; 
 }
 
 
+// --------------------------------------------------------
+// sx_mgmt_video_free_nal_unit
+//      Drop a reference, the last one frees the NAL unit.
+//
 void sx_mgmt_video_free_nal_unit(
     sMGMT_VIDEO_NAL_UNIT   *nal_unit
     )
 {
-    free(nal_unit); 
+    if(__atomic_sub_fetch(&nal_unit->ref_count, 1, __ATOMIC_ACQ_REL) != 0)
+    {
+        return; 
+    }
+
+    if(nal_unit->hw_buf != NULL)
+    {
+        // Last user of the camera buffer, hand it back. 
+        sx_camera_hw_release(nal_unit->hw_buf); 
+    }
+
+    sx_slab_free(nal_unit); 
 }
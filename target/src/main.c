@@ -1,17 +1,260 @@
 
-#include "stdio.h" 
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "unistd.h"
+#include "time.h"
 #include "assert.h"
 
 #include "sx_mgmt_sys.h"
+#include "sx_mgmt_camera_hw.h"
+#include "sx_mgmt_video.h"
+#include "sx_mgmt_rtp.h"
+#include "sx_nal_scan.h"
+#include "sx_ring.h"
+#include "sx_reactor.h"
+#include "sx_timer.h"
+#include "sx_uring.h"
+#include "nal_to_rtp.h"
+
+#define BENCHMARK_SIZE          (4 * 1024 * 1024)
+#define BENCHMARK_ITERATIONS    64
+#define BENCHMARK_RING_ITEMS    (4 * 1024 * 1024)
+#define BENCHMARK_RTP_SESSIONS  20
+#define BENCHMARK_RTP_NAL_UNITS 256
+#define BENCHMARK_TIMERS        10000
+#define BENCHMARK_TIMER_ROUNDS  100
+
+
+static void usage(
+    char   *name
+    )
+{
+    printf("Usage: %s [-r file.h264 [-l] | -s [-b bps] [-g gop] [-i ratio] [-j pct] [-n slices]] [-f fps] [-z] [-L] [-q len] [-p policy] [-w workers] [-P ms] [-R kbps] [-T kbytes] [-G] [-U] [-E] [-B]\n"
+           "    -r  Replay an Annex-B H.264 file or FIFO instead of the camera\n"
+           "    -l  Loop the replay at end of stream\n"
+           "    -s  Generate a synthetic H.264 load pattern instead of the camera\n"
+           "    -b  Synthetic bitrate in bits per second\n"
+           "    -g  Synthetic GOP length in frames\n"
+           "    -i  Synthetic IDR size as a multiple of a P frame\n"
+           "    -j  Synthetic frame size spread in +/- percent\n"
+           "    -n  Slice NAL units per frame (synthetic, or camera with -L)\n"
+           "    -f  Replay/synthetic frame rate, 0 = as fast as possible (default 30)\n"
+           "    -z  Zero-copy, pass retained source buffers downstream\n"
+           "    -L  Low latency, camera forwards each slice as soon as it is encoded\n"
+           "    -q  NAL units queued per stage at most, 0 = unbounded (default %d)\n"
+           "    -p  Full queue policy: block, newest, oldest or idr (default idr, block with -f 0)\n"
+           "    -w  RTP send threads, each pinned to a core, 0 = none (default)\n"
+           "    -P  Spread each NAL unit's packets over ms milliseconds, 0 = send at once (default %d, 0 with -f 0)\n"
+           "    -R  Per session send rate cap in kbps, 0 = none (default)\n"
+           "    -T  Output budget of an RTP over RTSP (TCP) session in KB, 0 = none (default %d)\n"
+           "    -G  Send every RTP packet on its own, without UDP GSO\n"
+           "    -U  Send RTP packets and RTSP responses through io_uring\n"
+           "    -E  Run the managers and RTSP from one event loop thread\n"
+           "    -B  Benchmark the start code scanner and queues and exit\n",
+           name,
+           SX_CAMERA_HW_QUEUE_LEN,
+           SX_MGMT_RTP_PACE_WINDOW_US / 1000,
+           SX_MGMT_RTP_TCP_BUDGET / 1024);
+}
+
+
+// Queue policy by option name, -1 if unknown.
+static int queue_policy_get(
+    const char *name
+    )
+{
+    if(strcmp(name, "block") == 0)
+    {
+        return SX_QUEUE_POLICY_BLOCK;
+    }
+    else if(strcmp(name, "newest") == 0)
+    {
+        return SX_QUEUE_POLICY_DROP_NEWEST;
+    }
+    else if(strcmp(name, "oldest") == 0)
+    {
+        return SX_QUEUE_POLICY_DROP_OLDEST;
+    }
+    else if(strcmp(name, "idr") == 0)
+    {
+        return SX_QUEUE_POLICY_DROP_TO_KEY;
+    }
+
+    return -1;
+}
+
 
 int main(
-    void
+    int     argc,
+    char   *argv[]
     )
 {
+    sSX_CAMERA_HW_CONFIG    config;
+    sSX_MGMT_VIDEO_CONFIG   video_config;
+    sSX_MGMT_RTP_CONFIG     rtp_config;
+    int                     policy;
+    int                     pace_window_ms;
+    int                     opt;
+
+
+    // Camera by default.
+    sx_camera_hw_config_get(&config);
+    sx_mgmt_video_config_get(&video_config);
+    sx_mgmt_rtp_config_get(&rtp_config);
+
+    policy          = -1;
+    pace_window_ms  = -1;
+
+    // Sessions draw their SSRC and timestamp origin from rand(). 
+    srand(time(NULL) ^ getpid()); 
+
+    while((opt = getopt(argc, argv, "r:lsb:g:i:j:n:f:zLq:p:w:P:R:T:GUEB")) != -1)
+    {
+        switch(opt)
+        {
+            case 'r':
+                config.source           = SX_CAMERA_HW_SOURCE_REPLAY;
+                config.replay_path      = optarg;
+                break;
+
+            case 'l':
+                config.replay_loop      = 1;
+                break;
+
+            case 's':
+                config.source           = SX_CAMERA_HW_SOURCE_SYNTHETIC;
+                break;
+
+            case 'b':
+                config.synth_bitrate    = atoi(optarg);
+                break;
+
+            case 'g':
+                config.synth_gop        = atoi(optarg);
+                break;
+
+            case 'i':
+                config.synth_idr_ratio  = atoi(optarg);
+                break;
+
+            case 'j':
+                config.synth_jitter     = atoi(optarg);
+                break;
+
+            case 'n':
+                config.slices           = atoi(optarg);
+                if((config.slices < 1) || (config.slices > SX_CAMERA_HW_SLICES_MAX))
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+
+            case 'f':
+                config.fps              = atoi(optarg);
+                break;
+
+            case 'z':
+                config.zero_copy        = 1;
+                break;
+
+            case 'L':
+                config.low_latency      = 1;
+                break;
+
+            case 'q':
+                config.queue_len        = atoi(optarg);
+                break;
+
+            case 'p':
+                policy = queue_policy_get(optarg);
+                if(policy < 0)
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+
+            case 'w':
+                rtp_config.workers      = atoi(optarg);
+                if(rtp_config.workers > SX_MGMT_RTP_WORKERS_MAX)
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+
+            case 'P':
+                pace_window_ms = atoi(optarg);
+                break;
+
+            case 'R':
+                rtp_config.session_rate_max = atoi(optarg) * 1000;
+                break;
+
+            case 'T':
+                rtp_config.tcp_budget = atoi(optarg) * 1024;
+                break;
+
+            case 'G':
+                rtp_config.gso = 0;
+                break;
+
+            case 'U':
+                sx_uring_init();
+                break;
+
+            case 'E':
+                sx_reactor_init();
+                break;
+
+            case 'B':
+                sx_nal_scan_benchmark(BENCHMARK_SIZE, BENCHMARK_ITERATIONS);
+                sx_ring_benchmark(BENCHMARK_RING_ITEMS);
+                sx_nal_to_rtp_benchmark(BENCHMARK_RTP_SESSIONS, BENCHMARK_RTP_NAL_UNITS);
+                sx_timer_benchmark(BENCHMARK_TIMERS, BENCHMARK_TIMER_ROUNDS);
+                return 0;
+
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(policy < 0)
+    {
+        // Unpaced sources run as fast as the pipeline drains, not faster.
+        policy = (config.fps == 0) ? SX_QUEUE_POLICY_BLOCK : SX_QUEUE_POLICY_DROP_TO_KEY;
+    }
+
+    if((config.fps == 0) && (config.queue_len == 0))
+    {
+        // Nothing else holds an unpaced source back.
+        config.queue_len = SX_CAMERA_HW_QUEUE_LEN;
+    }
+
+    if(pace_window_ms >= 0)
+    {
+        rtp_config.pace_window_us = pace_window_ms * 1000;
+    }
+    else if(config.fps == 0)
+    {
+        // Frames come back to back, there is no interval to spread over.
+        rtp_config.pace_window_us = 0;
+    }
+
+    config.queue_policy         = policy;
+    video_config.queue_len      = config.queue_len;
+    video_config.queue_policy   = policy;
+
+    sx_camera_hw_config_set(&config);
+    sx_mgmt_video_config_set(&video_config);
+    sx_mgmt_rtp_config_set(&rtp_config);
+
     mgmt_sys_init();
 
     mgmt_sys_open();
 
-    return 0; 
+    return 0;
 }
-